@@ -1,118 +1,50 @@
 #include <cstdlib>
 
-#include <filesystem>
-#include <functional>
-#include <iostream>
-#include <map>
-#include <string_view>
-#include <unordered_set>
-#include <vector>
-
-using std::literals::string_view_literals::operator""sv;
+#include "rez/rez.hpp"
 
 static int cmake_init() {
-    return system("cmake -B build .");
+    return rez::Run({ "cmake", "-B", "build", "." }).Wait();
 }
 
 static int build() {
-    const int status{ cmake_init() };
-
-    if (status) {
-        return status;
-    }
-
-    return system("cmake --build build --config Release");
+    return rez::Run({ "cmake", "--build", "build", "--config", "Release" }).Wait();
 }
 
 static int install() {
-    const int status{ build() };
-
-    if (status) {
-        return status;
-    }
-
-    return system("cmake --build build --target install");
+    return rez::Run({ "cmake", "--build", "build", "--target", "install" }).Wait();
 }
 
 static int uninstall() {
-    const int status{ cmake_init() };
-
-    if (status) {
-        return status;
-    }
-
-    return system("cmake --build build --target uninstall");
+    return rez::Run({ "cmake", "--build", "build", "--target", "uninstall" }).Wait();
 }
 
 static int run() {
-    const int status{ install() };
-
-    if (status) {
-        return status;
-    }
-
-    return system("athena");
+    return rez::Run({ "athena" }).Wait();
 }
 
 static int clean_bin() {
-    std::filesystem::remove_all("bin");
+    rez::RemoveTree("bin");
     return EXIT_SUCCESS;
 }
 
 static int clean_cmake() {
-    std::filesystem::remove_all("build");
+    rez::RemoveTree("build");
     return EXIT_SUCCESS;
 }
 
 static int clean() {
-    clean_bin();
-    clean_cmake();
     return EXIT_SUCCESS;
 }
 
 int main(int argc, const char **argv) {
-    const std::vector<std::string_view> args{ argv + 1, argv + argc };
-    const std::function<int()> default_task{ run };
-
-    if (args.empty()) {
-        if (default_task()) {
-            return EXIT_FAILURE;
-        }
-
-        return EXIT_SUCCESS;
-    }
-
-    const std::map<std::string_view, std::function<int()>> tasks{
-        { "clean"sv, clean },
-        { "clean_bin"sv, clean_bin },
-        { "clean_cmake"sv, clean_cmake },
-        { "cmake_init"sv, cmake_init },
-        { "build"sv, build },
-        { "install"sv, install },
-        { "run"sv, run },
-        { "uninstall"sv, uninstall }
-    };
-
-    if (args.front() == "-l") {
-        for (const auto &[name, _] : tasks) {
-            std::cout << name << "\n";
-        }
-
-        return EXIT_SUCCESS;
-    }
-
-    for (const std::string_view &arg : args) {
-        try {
-            const std::function<int()> f{ tasks.at(arg) };
-
-            if (f()) {
-                return EXIT_FAILURE;
-            }
-        } catch (std::out_of_range &e) {
-            std::cerr << "no such task: " << arg << "\n";
-            return EXIT_FAILURE;
-        }
-    }
-
-    return EXIT_SUCCESS;
+    rez::TaskGraph tasks;
+    tasks.Add("clean", { "clean_bin", "clean_cmake" }, clean);
+    tasks.Add("clean_bin", {}, clean_bin);
+    tasks.Add("clean_cmake", {}, clean_cmake);
+    tasks.Add("cmake_init", {}, rez::Incremental("cmake_init", { "CMakeLists.txt" }, { "build/CMakeCache.txt" }, cmake_init));
+    tasks.Add("build", { "cmake_init" }, rez::Incremental("build", { "CMakeLists.txt", "athena.cpp" }, { "build/bin/**" }, build));
+    tasks.Add("install", { "build" }, install);
+    tasks.Add("run", { "install" }, run);
+    tasks.Add("uninstall", { "cmake_init" }, uninstall);
+    return tasks.Main(argc, argv, "run");
 }
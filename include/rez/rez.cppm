@@ -0,0 +1,17 @@
+/**
+ * @copyright 2021 YelloSoft
+ *
+ * @file rez.cppm
+ *
+ * @brief rez.cppm offers the rez API as a C++20 module, for task definitions which `import rez;`.
+ *
+ * rez compiles a copy of this interface, @ref rez::ModuleInterface, once per compiler and flags.
+ */
+
+module;
+#define REZ_MODULE_INCLUDES_ONLY
+#include <rez/rez.hpp>
+#undef REZ_MODULE_INCLUDES_ONLY
+export module rez;
+#define REZ_EXPORT export
+#include <rez/rez.hpp>
@@ -0,0 +1,1052 @@
+#pragma once
+
+/**
+ * @copyright 2021 YelloSoft
+ *
+ * @file rez.h
+ *
+ * @brief rez.h offers header-only helpers for C task definitions.
+ *
+ * The filesystem helpers require POSIX.1-2008. Under strict modes such as -std=c17, include rez.h ahead of any other header, or define _POSIX_C_SOURCE (or _XOPEN_SOURCE, _GNU_SOURCE) in CFLAGS.
+ */
+
+#if !defined(_WIN32) && !defined(__APPLE__) && !defined(_POSIX_C_SOURCE) && !defined(_XOPEN_SOURCE) && !defined(_GNU_SOURCE) && !defined(_DEFAULT_SOURCE) && !defined(_BSD_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <shellapi.h>
+#if defined(_MSC_VER)
+#pragma comment(lib, "shell32")
+#endif
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief rez_task denotes a named unit of work, with prerequisites.
+ */
+struct rez_task {
+    /**
+     * @brief name identifies the task on the command line.
+     */
+    const char *name;
+
+    /**
+     * @brief run performs the work, returning a POSIX-style exit status.
+     */
+    int (*run)(void);
+
+    /**
+     * @brief dependencies names the tasks which must succeed before this task runs, terminated by NULL. May be NULL.
+     */
+    const char *const *dependencies;
+};
+
+/**
+ * @brief rez_task_index locates a task by name.
+ *
+ * @param tasks a task table
+ * @param task_sz the number of tasks
+ * @param name a task name
+ * @returns the index of the task, or task_sz when not found
+ */
+static inline size_t rez_task_index(const struct rez_task *tasks, size_t task_sz, const char *name) {
+    for (size_t i = 0; i < task_sz; i++) {
+        if (strcmp(tasks[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    return task_sz;
+}
+
+/**
+ * @brief rez_run_task runs a task after its transitive dependencies, skipping any which already ran.
+ *
+ * @param tasks a task table
+ * @param task_sz the number of tasks
+ * @param marks per-task state, zero initialized by the caller and shared across calls: 0 pending, 1 running, 2 done
+ * @param name a task name
+ * @returns the first non-zero task exit status, or EXIT_SUCCESS
+ */
+static inline int rez_run_task(const struct rez_task *tasks, size_t task_sz, unsigned char *marks, const char *name) {
+    const size_t i = rez_task_index(tasks, task_sz, name);
+
+    if (i == task_sz) {
+        fprintf(stderr, "error: no such task: %s\n", name);
+        return EXIT_FAILURE;
+    }
+
+    if (marks[i] == 2) {
+        return EXIT_SUCCESS;
+    }
+
+    if (marks[i] == 1) {
+        fprintf(stderr, "error: task dependency cycle at: %s\n", name);
+        return EXIT_FAILURE;
+    }
+
+    marks[i] = 1;
+
+    if (tasks[i].dependencies != NULL) {
+        for (const char *const *dependency = tasks[i].dependencies; *dependency != NULL; dependency++) {
+            const int status = rez_run_task(tasks, task_sz, marks, *dependency);
+
+            if (status != EXIT_SUCCESS) {
+                return status;
+            }
+        }
+    }
+
+    const int status = tasks[i].run();
+
+    if (status != EXIT_SUCCESS) {
+        return status;
+    }
+
+    marks[i] = 2;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief rez_main implements a conventional task definition entrypoint.
+ *
+ * No arguments runs the default task. -l lists the available tasks. Otherwise, each named task runs in turn, and each task runs at most once.
+ *
+ * @param tasks a task table
+ * @param task_sz the number of tasks
+ * @param default_task the task to run when no task names are supplied
+ * @param argc argument count
+ * @param argv CLI arguments
+ * @returns CLI exit code
+ */
+static inline int rez_main(const struct rez_task *tasks, size_t task_sz, const char *default_task, int argc, const char **argv) {
+    if (argc > 1 && strcmp(argv[1], "-l") == 0) {
+        for (size_t i = 0; i < task_sz; i++) {
+            printf("%s\n", tasks[i].name);
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (rez_task_index(tasks, task_sz, argv[i]) == task_sz) {
+            fprintf(stderr, "error: no such task: %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    unsigned char *marks = calloc(task_sz, sizeof(unsigned char));
+
+    if (marks == NULL) {
+        fprintf(stderr, "error: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+
+    if (argc < 2) {
+        status = rez_run_task(tasks, task_sz, marks, default_task);
+    }
+
+    for (int i = 1; i < argc && status == EXIT_SUCCESS; i++) {
+        status = rez_run_task(tasks, task_sz, marks, argv[i]);
+    }
+
+    free(marks);
+    return status == EXIT_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#if !defined(_WIN32)
+/**
+ * @brief rez_copy_string duplicates a string, like strdup.
+ *
+ * @param s a string
+ * @returns a copy owned by the caller, or NULL when out of memory
+ */
+static inline char *rez_copy_string(const char *s) {
+    const size_t sz = strlen(s) + 1;
+    char *copy = malloc(sz);
+
+    if (copy != NULL) {
+        memcpy(copy, s, sz);
+    }
+
+    return copy;
+}
+
+/**
+ * @brief rez_jobs determines the number of threads for the filesystem helpers.
+ *
+ * @returns REZ_JOBS when set to a positive integer, otherwise the number of online CPUs; at most 64
+ */
+static inline long rez_jobs(void) {
+    long jobs = 0;
+    const char *jobs_s = getenv("REZ_JOBS");
+
+    if (jobs_s != NULL) {
+        jobs = strtol(jobs_s, NULL, 10);
+    }
+
+    if (jobs < 1) {
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    if (jobs < 1) {
+        jobs = 1;
+    }
+
+    return jobs > 64 ? 64 : jobs;
+}
+
+/**
+ * @brief rez_remove_state shares a directory work list among rez_remove_tree workers.
+ */
+struct rez_remove_state {
+    /**
+     * @brief mutex guards the remaining fields.
+     */
+    pthread_mutex_t mutex;
+
+    /**
+     * @brief cond signals new pending directories, or completion.
+     */
+    pthread_cond_t cond;
+
+    /**
+     * @brief pending lists directories awaiting a worker.
+     */
+    char **pending;
+
+    /**
+     * @brief pending_sz denotes the number of pending directories.
+     */
+    size_t pending_sz;
+
+    /**
+     * @brief pending_cap denotes the capacity of pending.
+     */
+    size_t pending_cap;
+
+    /**
+     * @brief visited lists every directory found, each after its parent.
+     */
+    char **visited;
+
+    /**
+     * @brief visited_sz denotes the number of visited directories.
+     */
+    size_t visited_sz;
+
+    /**
+     * @brief visited_cap denotes the capacity of visited.
+     */
+    size_t visited_cap;
+
+    /**
+     * @brief active denotes the number of workers currently listing a directory.
+     */
+    size_t active;
+
+    /**
+     * @brief status denotes the first failure, or EXIT_SUCCESS.
+     */
+    int status;
+};
+
+/**
+ * @brief rez_push_path appends a path to a growable array.
+ *
+ * @param items an array
+ * @param sz the number of items
+ * @param cap the capacity
+ * @param path a path, owned by the array on success
+ * @returns true on success
+ */
+static inline bool rez_push_path(char ***items, size_t *sz, size_t *cap, char *path) {
+    if (*sz == *cap) {
+        const size_t new_cap = *cap == 0 ? 64 : *cap * 2;
+        char **new_items = realloc(*items, new_cap * sizeof(char *));
+
+        if (new_items == NULL) {
+            return false;
+        }
+
+        *items = new_items;
+        *cap = new_cap;
+    }
+
+    (*items)[(*sz)++] = path;
+    return true;
+}
+
+/**
+ * @brief rez_remove_worker unlinks the files of pending directories, queueing their subdirectories, until none remain.
+ *
+ * @param arg a struct rez_remove_state
+ * @returns NULL
+ */
+static inline void *rez_remove_worker(void *arg) {
+    struct rez_remove_state *state = arg;
+    pthread_mutex_lock(&state->mutex);
+
+    for (;;) {
+        while (state->pending_sz == 0 && state->active > 0 && state->status == EXIT_SUCCESS) {
+            pthread_cond_wait(&state->cond, &state->mutex);
+        }
+
+        if (state->pending_sz == 0 || state->status != EXIT_SUCCESS) {
+            pthread_cond_broadcast(&state->cond);
+            pthread_mutex_unlock(&state->mutex);
+            return NULL;
+        }
+
+        char *directory = state->pending[--state->pending_sz];
+        state->active++;
+        pthread_mutex_unlock(&state->mutex);
+
+        char **subdirectories = NULL;
+        size_t subdirectory_sz = 0;
+        size_t subdirectory_cap = 0;
+        int status = EXIT_SUCCESS;
+        DIR *dir = opendir(directory);
+
+        if (dir == NULL) {
+            fprintf(stderr, "error: unable to open directory: %s\n", directory);
+            status = EXIT_FAILURE;
+        }
+
+        for (const struct dirent *entry = dir == NULL ? NULL : readdir(dir); entry != NULL && status == EXIT_SUCCESS; entry = readdir(dir)) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+
+            const size_t path_sz = strlen(directory) + strlen(entry->d_name) + 2;
+            char *path = malloc(path_sz);
+
+            if (path == NULL) {
+                fprintf(stderr, "error: out of memory\n");
+                status = EXIT_FAILURE;
+                break;
+            }
+
+            snprintf(path, path_sz, "%s/%s", directory, entry->d_name);
+            bool is_directory;
+
+#if defined(DT_DIR)
+            if (entry->d_type != DT_UNKNOWN) {
+                is_directory = entry->d_type == DT_DIR;
+            } else
+#endif
+            {
+                struct stat buf;
+                is_directory = lstat(path, &buf) == 0 && S_ISDIR(buf.st_mode);
+            }
+
+            if (is_directory) {
+                if (!rez_push_path(&subdirectories, &subdirectory_sz, &subdirectory_cap, path)) {
+                    free(path);
+                    fprintf(stderr, "error: out of memory\n");
+                    status = EXIT_FAILURE;
+                }
+
+                continue;
+            }
+
+            if (unlink(path) != 0 && errno != ENOENT) {
+                fprintf(stderr, "error: unable to remove path: %s\n", path);
+                status = EXIT_FAILURE;
+            }
+
+            free(path);
+        }
+
+        if (dir != NULL) {
+            closedir(dir);
+        }
+
+        free(directory);
+
+        pthread_mutex_lock(&state->mutex);
+
+        for (size_t i = 0; i < subdirectory_sz; i++) {
+            char *copy = status == EXIT_SUCCESS ? rez_copy_string(subdirectories[i]) : NULL;
+
+            if (copy == NULL || !rez_push_path(&state->visited, &state->visited_sz, &state->visited_cap, subdirectories[i])) {
+                free(copy);
+                free(subdirectories[i]);
+                status = EXIT_FAILURE;
+                continue;
+            }
+
+            if (!rez_push_path(&state->pending, &state->pending_sz, &state->pending_cap, copy)) {
+                free(copy);
+                status = EXIT_FAILURE;
+            }
+        }
+
+        free(subdirectories);
+
+        if (state->status == EXIT_SUCCESS) {
+            state->status = status;
+        }
+
+        state->active--;
+        pthread_cond_broadcast(&state->cond);
+    }
+}
+#endif
+
+/**
+ * @brief rez_remove_tree removes a file or directory tree, like rm -rf.
+ *
+ * On UNIX systems, files are unlinked across subdirectories in parallel, with REZ_JOBS (else one per CPU) threads. Symlinks are not followed.
+ *
+ * @param path a path, which need not exist
+ * @returns EXIT_SUCCESS, or non-zero on error
+ */
+static inline int rez_remove_tree(const char *path) {
+#if defined(_WIN32)
+    if (GetFileAttributesA(path) == INVALID_FILE_ATTRIBUTES) {
+        return EXIT_SUCCESS;
+    }
+
+    // Double null terminated per SHFileOperation requirements.
+    char *paths = calloc(strlen(path) + 2, sizeof(char));
+
+    if (paths == NULL) {
+        fprintf(stderr, "error: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    strcpy(paths, path);
+
+    SHFILEOPSTRUCTA shfo = {
+        NULL,
+        FO_DELETE,
+        paths,
+        NULL,
+        FOF_SILENT | FOF_NOERRORUI | FOF_NOCONFIRMATION,
+        FALSE,
+        NULL,
+        NULL
+    };
+    const int status = SHFileOperationA(&shfo);
+    free(paths);
+
+    if (status) {
+        fprintf(stderr, "error: unable to remove path: %s\n", path);
+    }
+
+    return status;
+#else
+    struct stat buf;
+
+    if (lstat(path, &buf) != 0) {
+        if (errno == ENOENT) {
+            return EXIT_SUCCESS;
+        }
+
+        fprintf(stderr, "error: unable to query for path: %s\n", path);
+        return EXIT_FAILURE;
+    }
+
+    if (!S_ISDIR(buf.st_mode)) {
+        if (unlink(path) != 0) {
+            fprintf(stderr, "error: unable to remove path: %s\n", path);
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    struct rez_remove_state state = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0, 0, NULL, 0, 0, 0, EXIT_SUCCESS };
+    char *root = rez_copy_string(path);
+    char *root_copy = rez_copy_string(path);
+
+    if (root == NULL || root_copy == NULL || !rez_push_path(&state.visited, &state.visited_sz, &state.visited_cap, root)) {
+        free(root);
+        free(root_copy);
+        fprintf(stderr, "error: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!rez_push_path(&state.pending, &state.pending_sz, &state.pending_cap, root_copy)) {
+        free(root_copy);
+        state.status = EXIT_FAILURE;
+    }
+
+    const long jobs = rez_jobs();
+    pthread_t threads[64];
+    long started = 0;
+
+    // The calling thread works too.
+    while (started < jobs - 1 && pthread_create(&threads[started], NULL, rez_remove_worker, &state) == 0) {
+        started++;
+    }
+
+    rez_remove_worker(&state);
+
+    for (long i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (size_t i = 0; i < state.pending_sz; i++) {
+        free(state.pending[i]);
+    }
+
+    free(state.pending);
+
+    // Each directory was recorded after its parent, so reverse order empties children first.
+    for (size_t i = state.visited_sz; i > 0; i--) {
+        if (state.status == EXIT_SUCCESS && rmdir(state.visited[i - 1]) != 0) {
+            fprintf(stderr, "error: unable to remove path: %s\n", state.visited[i - 1]);
+            state.status = EXIT_FAILURE;
+        }
+
+        free(state.visited[i - 1]);
+    }
+
+    free(state.visited);
+    pthread_mutex_destroy(&state.mutex);
+    pthread_cond_destroy(&state.cond);
+    return state.status;
+#endif
+}
+
+#if !defined(_WIN32)
+/**
+ * @brief rez_join_path joins a directory and a relative path.
+ *
+ * @param directory a path
+ * @param relative a relative path, or the empty string
+ * @returns a path owned by the caller, or NULL when out of memory
+ */
+static inline char *rez_join_path(const char *directory, const char *relative) {
+    if (*relative == '\0') {
+        return rez_copy_string(directory);
+    }
+
+    const size_t path_sz = strlen(directory) + strlen(relative) + 2;
+    char *path = malloc(path_sz);
+
+    if (path != NULL) {
+        snprintf(path, path_sz, "%s/%s", directory, relative);
+    }
+
+    return path;
+}
+
+/**
+ * @brief rez_mirror_file copies a regular file, preserving its mode and modification time.
+ *
+ * @param source a source path
+ * @param destination a destination path
+ * @param source_buf the lstat result for source
+ * @param sync whether to skip files whose size and modification time already match
+ * @returns EXIT_SUCCESS, or non-zero on error
+ */
+static inline int rez_mirror_file(const char *source, const char *destination, const struct stat *source_buf, bool sync) {
+#if defined(__APPLE__)
+    const struct timespec mtime = source_buf->st_mtimespec;
+#else
+    const struct timespec mtime = source_buf->st_mtim;
+#endif
+    struct stat buf;
+
+    if (lstat(destination, &buf) == 0) {
+        if (S_ISREG(buf.st_mode)) {
+#if defined(__APPLE__)
+            const struct timespec destination_mtime = buf.st_mtimespec;
+#else
+            const struct timespec destination_mtime = buf.st_mtim;
+#endif
+
+            if (sync && buf.st_size == source_buf->st_size && destination_mtime.tv_sec == mtime.tv_sec && destination_mtime.tv_nsec == mtime.tv_nsec) {
+                return EXIT_SUCCESS;
+            }
+        } else if (rez_remove_tree(destination) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    const int in = open(source, O_RDONLY);
+
+    if (in < 0) {
+        fprintf(stderr, "error: unable to open file: %s\n", source);
+        return EXIT_FAILURE;
+    }
+
+    const int out = open(destination, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+    if (out < 0) {
+        fprintf(stderr, "error: unable to open file: %s\n", destination);
+        close(in);
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    char buffer[65536];
+
+    for (;;) {
+        const ssize_t n = read(in, buffer, sizeof(buffer));
+
+        if (n == 0) {
+            break;
+        }
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            status = EXIT_FAILURE;
+            break;
+        }
+
+        for (ssize_t written = 0; written < n && status == EXIT_SUCCESS;) {
+            const ssize_t m = write(out, buffer + written, (size_t) (n - written));
+
+            if (m < 0 && errno != EINTR) {
+                status = EXIT_FAILURE;
+            } else if (m > 0) {
+                written += m;
+            }
+        }
+
+        if (status != EXIT_SUCCESS) {
+            break;
+        }
+    }
+
+    const struct timespec times[2] = { { 0, UTIME_OMIT }, mtime };
+
+    if (status == EXIT_SUCCESS && (fchmod(out, source_buf->st_mode & 07777) != 0 || futimens(out, times) != 0)) {
+        status = EXIT_FAILURE;
+    }
+
+    if (close(out) != 0) {
+        status = EXIT_FAILURE;
+    }
+
+    close(in);
+
+    if (status != EXIT_SUCCESS) {
+        fprintf(stderr, "error: unable to copy file: %s\n", source);
+    }
+
+    return status;
+}
+
+/**
+ * @brief rez_mirror_entry copies a single file, symlink, or (empty) directory.
+ *
+ * Other file types are skipped.
+ *
+ * @param source a source path
+ * @param destination a destination path
+ * @param source_buf the lstat result for source
+ * @param sync whether to skip files whose size and modification time already match
+ * @returns EXIT_SUCCESS, or non-zero on error
+ */
+static inline int rez_mirror_entry(const char *source, const char *destination, const struct stat *source_buf, bool sync) {
+    struct stat buf;
+    const bool exists = lstat(destination, &buf) == 0;
+
+    if (S_ISDIR(source_buf->st_mode)) {
+        if (exists && S_ISDIR(buf.st_mode)) {
+            return EXIT_SUCCESS;
+        }
+
+        if ((exists && rez_remove_tree(destination) != EXIT_SUCCESS) || mkdir(destination, (source_buf->st_mode & 07777) | 0700) != 0) {
+            fprintf(stderr, "error: unable to create directory: %s\n", destination);
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    if (S_ISREG(source_buf->st_mode)) {
+        return rez_mirror_file(source, destination, source_buf, sync);
+    }
+
+    if (!S_ISLNK(source_buf->st_mode)) {
+        return EXIT_SUCCESS;
+    }
+
+    char target[4096];
+    const ssize_t target_sz = readlink(source, target, sizeof(target) - 1);
+
+    if (target_sz < 0) {
+        fprintf(stderr, "error: unable to read symlink: %s\n", source);
+        return EXIT_FAILURE;
+    }
+
+    target[target_sz] = '\0';
+
+    if ((exists && rez_remove_tree(destination) != EXIT_SUCCESS) || symlink(target, destination) != 0) {
+        fprintf(stderr, "error: unable to create symlink: %s\n", destination);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief rez_mirror_state shares a directory copy between worker threads.
+ */
+struct rez_mirror_state {
+    /**
+     * @brief mutex guards the remaining fields.
+     */
+    pthread_mutex_t mutex;
+
+    /**
+     * @brief cond signals new pending directories, or completion.
+     */
+    pthread_cond_t cond;
+
+    /**
+     * @brief source denotes the source root.
+     */
+    const char *source;
+
+    /**
+     * @brief destination denotes the destination root.
+     */
+    const char *destination;
+
+    /**
+     * @brief sync denotes whether to skip unchanged files and remove extraneous destination entries.
+     */
+    bool sync;
+
+    /**
+     * @brief pending lists directories yet to copy, relative to both roots.
+     */
+    char **pending;
+
+    /**
+     * @brief pending_sz denotes the number of pending directories.
+     */
+    size_t pending_sz;
+
+    /**
+     * @brief pending_cap denotes the capacity of pending.
+     */
+    size_t pending_cap;
+
+    /**
+     * @brief active denotes the number of workers currently copying a directory.
+     */
+    size_t active;
+
+    /**
+     * @brief status denotes the first failure, or EXIT_SUCCESS.
+     */
+    int status;
+};
+
+/**
+ * @brief rez_mirror_directory copies the entries of one directory, collecting its subdirectories.
+ *
+ * @param state a struct rez_mirror_state
+ * @param relative a directory, relative to both roots
+ * @param subdirectories collects subdirectories, relative to both roots
+ * @param subdirectory_sz the number of subdirectories
+ * @param subdirectory_cap the capacity of subdirectories
+ * @returns EXIT_SUCCESS, or non-zero on error
+ */
+static inline int rez_mirror_directory(const struct rez_mirror_state *state, const char *relative, char ***subdirectories, size_t *subdirectory_sz, size_t *subdirectory_cap) {
+    char *source_directory = rez_join_path(state->source, relative);
+    char *destination_directory = rez_join_path(state->destination, relative);
+    int status = EXIT_SUCCESS;
+    DIR *dir = NULL;
+
+    if (source_directory == NULL || destination_directory == NULL) {
+        fprintf(stderr, "error: out of memory\n");
+        status = EXIT_FAILURE;
+    }
+
+    // Remove destination entries which no longer exist in the source.
+    if (status == EXIT_SUCCESS && state->sync && (dir = opendir(destination_directory)) != NULL) {
+        for (const struct dirent *entry = readdir(dir); entry != NULL && status == EXIT_SUCCESS; entry = readdir(dir)) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+
+            char *source_path = rez_join_path(source_directory, entry->d_name);
+            char *destination_path = rez_join_path(destination_directory, entry->d_name);
+            struct stat buf;
+
+            if (source_path == NULL || destination_path == NULL) {
+                fprintf(stderr, "error: out of memory\n");
+                status = EXIT_FAILURE;
+            } else if (lstat(source_path, &buf) != 0 && errno == ENOENT) {
+                status = rez_remove_tree(destination_path);
+            }
+
+            free(source_path);
+            free(destination_path);
+        }
+
+        closedir(dir);
+    }
+
+    dir = status == EXIT_SUCCESS ? opendir(source_directory) : NULL;
+
+    if (status == EXIT_SUCCESS && dir == NULL) {
+        fprintf(stderr, "error: unable to open directory: %s\n", source_directory);
+        status = EXIT_FAILURE;
+    }
+
+    for (const struct dirent *entry = dir == NULL ? NULL : readdir(dir); entry != NULL && status == EXIT_SUCCESS; entry = readdir(dir)) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        char *source_path = rez_join_path(source_directory, entry->d_name);
+        char *destination_path = rez_join_path(destination_directory, entry->d_name);
+        char *child = *relative == '\0' ? rez_copy_string(entry->d_name) : rez_join_path(relative, entry->d_name);
+        struct stat buf;
+
+        if (source_path == NULL || destination_path == NULL || child == NULL) {
+            fprintf(stderr, "error: out of memory\n");
+            status = EXIT_FAILURE;
+        } else if (lstat(source_path, &buf) != 0) {
+            fprintf(stderr, "error: unable to query for path: %s\n", source_path);
+            status = EXIT_FAILURE;
+        } else {
+            status = rez_mirror_entry(source_path, destination_path, &buf, state->sync);
+
+            if (status == EXIT_SUCCESS && S_ISDIR(buf.st_mode)) {
+                if (!rez_push_path(subdirectories, subdirectory_sz, subdirectory_cap, child)) {
+                    fprintf(stderr, "error: out of memory\n");
+                    status = EXIT_FAILURE;
+                } else {
+                    child = NULL;
+                }
+            }
+        }
+
+        free(source_path);
+        free(destination_path);
+        free(child);
+    }
+
+    if (dir != NULL) {
+        closedir(dir);
+    }
+
+    free(source_directory);
+    free(destination_directory);
+    return status;
+}
+
+/**
+ * @brief rez_mirror_worker copies pending directories, queueing their subdirectories, until none remain.
+ *
+ * @param arg a struct rez_mirror_state
+ * @returns NULL
+ */
+static inline void *rez_mirror_worker(void *arg) {
+    struct rez_mirror_state *state = arg;
+    pthread_mutex_lock(&state->mutex);
+
+    for (;;) {
+        while (state->pending_sz == 0 && state->active > 0 && state->status == EXIT_SUCCESS) {
+            pthread_cond_wait(&state->cond, &state->mutex);
+        }
+
+        if (state->pending_sz == 0 || state->status != EXIT_SUCCESS) {
+            pthread_cond_broadcast(&state->cond);
+            pthread_mutex_unlock(&state->mutex);
+            return NULL;
+        }
+
+        char *relative = state->pending[--state->pending_sz];
+        state->active++;
+        pthread_mutex_unlock(&state->mutex);
+
+        char **subdirectories = NULL;
+        size_t subdirectory_sz = 0;
+        size_t subdirectory_cap = 0;
+        int status = rez_mirror_directory(state, relative, &subdirectories, &subdirectory_sz, &subdirectory_cap);
+        free(relative);
+
+        pthread_mutex_lock(&state->mutex);
+
+        for (size_t i = 0; i < subdirectory_sz; i++) {
+            if (status != EXIT_SUCCESS || !rez_push_path(&state->pending, &state->pending_sz, &state->pending_cap, subdirectories[i])) {
+                free(subdirectories[i]);
+                status = EXIT_FAILURE;
+            }
+        }
+
+        free(subdirectories);
+
+        if (state->status == EXIT_SUCCESS) {
+            state->status = status;
+        }
+
+        state->active--;
+        pthread_cond_broadcast(&state->cond);
+    }
+}
+#endif
+
+/**
+ * @brief rez_mirror_tree copies a file or directory tree.
+ *
+ * @param source a source path
+ * @param destination a destination path
+ * @param sync whether to skip unchanged files and remove extraneous destination entries
+ * @returns EXIT_SUCCESS, or non-zero on error
+ */
+static inline int rez_mirror_tree(const char *source, const char *destination, bool sync) {
+#if defined(_WIN32)
+    const DWORD attributes = GetFileAttributesA(source);
+
+    if (attributes == INVALID_FILE_ATTRIBUTES) {
+        fprintf(stderr, "error: unable to query for path: %s\n", source);
+        return EXIT_FAILURE;
+    }
+
+    if (sync && rez_remove_tree(destination) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    const bool is_directory = (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+
+    if (is_directory && !CreateDirectoryA(destination, NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+        fprintf(stderr, "error: unable to create directory: %s\n", destination);
+        return EXIT_FAILURE;
+    }
+
+    // Double null terminated per SHFileOperation requirements.
+    char *sources = calloc(strlen(source) + 4, sizeof(char));
+    char *destinations = calloc(strlen(destination) + 2, sizeof(char));
+
+    if (sources == NULL || destinations == NULL) {
+        free(sources);
+        free(destinations);
+        fprintf(stderr, "error: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    strcpy(sources, source);
+
+    if (is_directory) {
+        strcat(sources, "\\*");
+    }
+
+    strcpy(destinations, destination);
+
+    SHFILEOPSTRUCTA shfo = {
+        NULL,
+        FO_COPY,
+        sources,
+        destinations,
+        FOF_SILENT | FOF_NOERRORUI | FOF_NOCONFIRMATION | FOF_NOCONFIRMMKDIR,
+        FALSE,
+        NULL,
+        NULL
+    };
+    const int status = SHFileOperationA(&shfo);
+    free(sources);
+    free(destinations);
+
+    if (status) {
+        fprintf(stderr, "error: unable to copy path: %s\n", source);
+    }
+
+    return status;
+#else
+    struct stat buf;
+
+    if (lstat(source, &buf) != 0) {
+        fprintf(stderr, "error: unable to query for path: %s\n", source);
+        return EXIT_FAILURE;
+    }
+
+    if (rez_mirror_entry(source, destination, &buf, sync) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    if (!S_ISDIR(buf.st_mode)) {
+        return EXIT_SUCCESS;
+    }
+
+    struct rez_mirror_state state = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, source, destination, sync, NULL, 0, 0, 0, EXIT_SUCCESS };
+    char *root = rez_copy_string("");
+
+    if (root == NULL || !rez_push_path(&state.pending, &state.pending_sz, &state.pending_cap, root)) {
+        free(root);
+        fprintf(stderr, "error: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    const long jobs = rez_jobs();
+    pthread_t threads[64];
+    long started = 0;
+
+    // The calling thread works too.
+    while (started < jobs - 1 && pthread_create(&threads[started], NULL, rez_mirror_worker, &state) == 0) {
+        started++;
+    }
+
+    rez_mirror_worker(&state);
+
+    for (long i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (size_t i = 0; i < state.pending_sz; i++) {
+        free(state.pending[i]);
+    }
+
+    free(state.pending);
+    pthread_mutex_destroy(&state.mutex);
+    pthread_cond_destroy(&state.cond);
+    return state.status;
+#endif
+}
+
+/**
+ * @brief rez_copy_tree copies a file or directory tree, like cp -R.
+ *
+ * On UNIX systems, directories are copied in parallel, with REZ_JOBS (else one per CPU) threads. Symlinks are copied as symlinks. File modes and modification times are preserved. Existing destination entries are overwritten; extraneous ones are kept.
+ *
+ * @param source a source path
+ * @param destination a destination path
+ * @returns EXIT_SUCCESS, or non-zero on error
+ */
+static inline int rez_copy_tree(const char *source, const char *destination) {
+    return rez_mirror_tree(source, destination, false);
+}
+
+/**
+ * @brief rez_sync_tree makes a destination tree match a source tree, like rsync -a --delete.
+ *
+ * Behaves like rez_copy_tree, except that files whose size and modification time already match are skipped, and destination entries missing from the source are removed.
+ *
+ * @param source a source path
+ * @param destination a destination path
+ * @returns EXIT_SUCCESS, or non-zero on error
+ */
+static inline int rez_sync_tree(const char *source, const char *destination) {
+    return rez_mirror_tree(source, destination, true);
+}
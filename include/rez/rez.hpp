@@ -1,5 +1,3 @@
-#pragma once
-
 /**
  * @copyright 2021 YelloSoft
  * @mainpage
@@ -7,48 +5,313 @@
  * @ref rez runs C++ tasks.
  */
 
+// The rez module includes these dependencies in its global module fragment, then the API in its purview.
+#if !defined(REZ_HPP_INCLUDES)
+#define REZ_HPP_INCLUDES
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <process.h>
+#include <sys/locking.h>
+#include <sys/stat.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/ioctl.h>
+#include <sys/syscall.h>
+#endif
+extern char **environ;
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <set>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#endif
+
+#if !defined(REZ_HPP) && !defined(REZ_MODULE_INCLUDES_ONLY)
+#define REZ_HPP
+
+/**
+ * @brief REZ_EXPORT exports the rez namespace when building the rez module, see rez/rez.cppm.
+ */
+#if !defined(REZ_EXPORT)
+#define REZ_EXPORT
+#endif
 
 /**
  * @brief rez manages C++ tasks.
  */
-namespace rez {
+REZ_EXPORT namespace rez {
 /**
  * @brief Version is semver.
  */
-constexpr char Version[]{ "0.0.16" };
+inline constexpr char Version[]{ "0.0.16" };
 
 /**
  * @brief TaskDefinitionCpp denotes the path to a C++ task definition source file.
  */
-constexpr char TaskDefinitionCpp[]{ "rez.cpp" };
+inline constexpr char TaskDefinitionCpp[]{ "rez.cpp" };
 
 /**
  * @brief TaskDefinitionC denotes the path to a C task definition source file.
  */
-constexpr char TaskDefinitionC[]{ "rez.c" };
+inline constexpr char TaskDefinitionC[]{ "rez.c" };
+
+/**
+ * @brief TaskDefinitionDir denotes the path to a directory of task definition source files, used when neither rez.cpp nor rez.c is present.
+ */
+inline constexpr char TaskDefinitionDir[]{ "rez" };
 
 /**
  * @brief CacheDir denotes the path to the rez internal cache directory.
  */
-constexpr char CacheDir[]{ ".rez" };
+inline constexpr char CacheDir[]{ ".rez" };
+
+/**
+ * @brief CacheFileBasename denotes the basename of the binary toolchain environment cache, housed in CacheDir.
+ */
+inline constexpr char CacheFileBasename[]{ "rez-env.bin" };
+
+/**
+ * @brief LockFileBasename denotes the basename of the lock file which serializes writers of CacheDir, such as delegate builds, across rez processes.
+ */
+inline constexpr char LockFileBasename[]{ "rez.lock" };
+
+/**
+ * @brief ServerSocketBasename denotes the file name of the rez server socket, per rez -s.
+ */
+inline constexpr char ServerSocketBasename[]{ "rez.sock" };
+
+/**
+ * @brief ManifestFileBasename denotes the basename of the delegate cache manifest, housed in CacheDir.
+ */
+inline constexpr char ManifestFileBasename[]{ "rez-manifest.txt" };
+
+/**
+ * @brief DefaultProfile denotes the delegate build profile applied when REZ_PROFILE is unset.
+ *
+ * The debug profile favors compile latency, stripping optimization and link time optimization flags from CXXFLAGS (CFLAGS). The release profile applies CXXFLAGS (CFLAGS) verbatim.
+ */
+inline constexpr char DefaultProfile[]{ "debug" };
+
+/**
+ * @brief CompilerFingerprintBasename denotes the basename of the compiler probe cache, housed in CacheDir.
+ */
+inline constexpr char CompilerFingerprintBasename[]{ "rez-compiler.txt" };
+
+/**
+ * @brief CompilerChoiceBasename denotes the file name of the cached REZ_COMPILER=fastest selections, per @ref Config::SelectCompiler.
+ */
+inline constexpr char CompilerChoiceBasename[]{ "rez-compiler-choice.txt" };
+
+/**
+ * @brief SharedCacheDirBasename denotes the basename of the machine-wide delegate store, housed in the user cache directory ($XDG_CACHE_HOME, ~/.cache, or %LOCALAPPDATA%).
+ */
+inline constexpr char SharedCacheDirBasename[]{ "rez" };
+
+/**
+ * @brief DepfileBasenameUnix denotes the basename of the make-style dependency file emitted by UNIX compilers, housed in CacheDir.
+ */
+inline constexpr char DepfileBasenameUnix[]{ "rez-deps.d" };
+
+/**
+ * @brief DepfileBasenameMSVC denotes the basename of the JSON dependency file emitted by cl /sourceDependencies, housed in CacheDir.
+ */
+inline constexpr char DepfileBasenameMSVC[]{ "rez-deps.json" };
+
+/**
+ * @brief PchDirBasename denotes the path inside of CacheDir where precompiled headers are housed, one subdirectory per compiler and flags.
+ */
+inline constexpr char PchDirBasename[]{ "pch" };
+
+/**
+ * @brief ObjectDirBasename denotes the path inside of CacheDir where per-file objects of a task definition directory are housed.
+ */
+inline constexpr char ObjectDirBasename[]{ "obj" };
+
+/**
+ * @brief PreludeBasenameCpp denotes the basename of the generated C++ prelude header.
+ */
+inline constexpr char PreludeBasenameCpp[]{ "rez-prelude.hpp" };
+
+/**
+ * @brief PreludeBasenameC denotes the basename of the generated C prelude header.
+ */
+inline constexpr char PreludeBasenameC[]{ "rez-prelude.h" };
+
+/**
+ * @brief PchFileBasenameMSVC denotes the basename of the precompiled header generated by cl /Yc.
+ */
+inline constexpr char PchFileBasenameMSVC[]{ "rez-prelude.pch" };
+
+/**
+ * @brief PchObjectBasenameMSVC denotes the basename of the object file generated by cl /Yc, which delegate builds link.
+ */
+inline constexpr char PchObjectBasenameMSVC[]{ "rez-prelude.obj" };
+
+/**
+ * @brief PchDisabledBasename denotes a marker file, placed in a precompiled header directory when the prelude fails to precompile.
+ *
+ * The marker records the digest of the headers behind the prelude, so that editing those headers retries precompilation.
+ */
+inline constexpr char PchDisabledBasename[]{ "disabled" };
+
+/**
+ * @brief PchDepfileBasenameUnix denotes the basename of the dependency file emitted when precompiling the prelude with UNIX compilers, housed in a precompiled header directory.
+ */
+inline constexpr char PchDepfileBasenameUnix[]{ "rez-prelude.d" };
+
+/**
+ * @brief PchDepfileBasenameMSVC denotes the basename of the dependency file emitted when precompiling the prelude with cl, housed in a precompiled header directory.
+ */
+inline constexpr char PchDepfileBasenameMSVC[]{ "rez-prelude.json" };
+
+/**
+ * @brief PchManifestBasename denotes the basename of the file recording the digest of the headers behind a precompiled prelude, housed in a precompiled header directory.
+ */
+inline constexpr char PchManifestBasename[]{ "rez-prelude.key" };
+
+/**
+ * @brief ModuleDirBasename denotes the path inside of CacheDir where the compiled rez module is housed, one subdirectory per compiler and flags.
+ */
+inline constexpr char ModuleDirBasename[]{ "modules" };
+
+/**
+ * @brief ModuleInterfaceBasename denotes the basename of the generated rez module interface unit, housed in a module directory.
+ */
+inline constexpr char ModuleInterfaceBasename[]{ "rez.cppm" };
+
+/**
+ * @brief ModuleDepfileBasenameUnix denotes the basename of the dependency file emitted when compiling the rez module with UNIX compilers, housed in a module directory.
+ */
+inline constexpr char ModuleDepfileBasenameUnix[]{ "rez-module.d" };
+
+/**
+ * @brief ModuleDepfileBasenameMSVC denotes the basename of the dependency file emitted when compiling the rez module with cl, housed in a module directory.
+ */
+inline constexpr char ModuleDepfileBasenameMSVC[]{ "rez-module.json" };
+
+/**
+ * @brief ModuleManifestBasename denotes the basename of the file recording the digest of the headers behind a compiled rez module, housed in a module directory.
+ */
+inline constexpr char ModuleManifestBasename[]{ "rez-module.key" };
+
+/**
+ * @brief ModuleInterface denotes the rez module interface unit, a copy of rez/rez.cppm.
+ */
+inline constexpr char ModuleInterface[]{ R"(module;
+#define REZ_MODULE_INCLUDES_ONLY
+#include <rez/rez.hpp>
+#undef REZ_MODULE_INCLUDES_ONLY
+export module rez;
+#define REZ_EXPORT export
+#include <rez/rez.hpp>
+)" };
+
+/**
+ * @brief PreludeCpp denotes the standard headers precompiled for C++ task definitions.
+ */
+inline constexpr char PreludeCpp[]{ R"(
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+)" };
+
+/**
+ * @brief PreludeCppApi precedes PreludeCpp for task definitions which include rez/rez.hpp themselves.
+ */
+inline constexpr char PreludeCppApi[]{ R"(
+#include <rez/rez.hpp>
+)" };
+
+/**
+ * @brief PreludeC denotes the standard headers precompiled for C task definitions.
+ */
+inline constexpr char PreludeC[]{ R"(
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+)" };
+
+/**
+ * @brief PreludeCApi precedes PreludeC for task definitions which include rez/rez.h themselves.
+ */
+inline constexpr char PreludeCApi[]{ R"(
+#include <rez/rez.h>
+)" };
+
+/**
+ * @brief StateDatabaseBasename denotes the basename of the binary file stat and task stamp database, housed in CacheDir.
+ */
+inline constexpr char StateDatabaseBasename[]{ "rez-state.db" };
 
 /**
- * @brief CacheFileBasename denotes the basename of the internal rez cache file.
+ * @brief OutputCacheDirBasename denotes the path inside of CacheDir where cached task outputs are housed, one subdirectory per task input digest.
  */
-constexpr char CacheFileBasename[]{ "rez-env.txt" };
+inline constexpr char OutputCacheDirBasename[]{ "outputs" };
+
+/**
+ * @brief OutputManifestBasename denotes the basename of the file listing the outputs in an output cache entry, written last.
+ */
+inline constexpr char OutputManifestBasename[]{ "rez-outputs.txt" };
 
 /**
  * @brief ArtifactDirBaename denotes the path insode of CacheDir where artifacts are housed.
  */
-constexpr char ArtifactDirBasename[]{ "bin" };
+inline constexpr char ArtifactDirBasename[]{ "bin" };
 
 /**
  * @brief ArtifactFileBasenameUnix denotes the basename of user task binaries generated by UNIX compilers.
  */
-constexpr char ArtifactFileBasenameUnix[]{ "delegate-rez" };
+inline constexpr char ArtifactFileBasenameUnix[]{ "delegate-rez" };
 
 /**
  * @brief DefaultCompilerWindows denotes the standard Microsoft Visual C++ (MSVC) compiler executable basename.
@@ -59,7 +322,7 @@ constexpr char ArtifactFileBasenameUnix[]{ "delegate-rez" };
  *
  * Custom flags may be passed to the compiler via a CPPFLAGS or CXXFLAGS environment variable.
  */
-constexpr char DefaultCompilerWindows[]{ "cl" };
+inline constexpr char DefaultCompilerWindows[]{ "cl" };
 
 /**
  * @brief DefaultCompilerUnixCpp denotes the standard UNIX C++ compiler executable basename.
@@ -68,7 +331,7 @@ constexpr char DefaultCompilerWindows[]{ "cl" };
  *
  * Custom flags may be passed to the compiler via a CPPFLAGS and/or CXXFLAGS environment variable.
  */
-constexpr char DefaultCompilerUnixCpp[]{ "c++" };
+inline constexpr char DefaultCompilerUnixCpp[]{ "c++" };
 
 /**
  * @brief DefaultCompilerUnixC denotes the standard UNIX C compiler executable basename.
@@ -77,19 +340,21 @@ constexpr char DefaultCompilerUnixCpp[]{ "c++" };
  *
  * Custom flags may be passed to the compiler via a CPPFLAGS and/or CFLAGS environment variable.
  */
-constexpr char DefaultCompilerUnixC[]{ "cc" };
+inline constexpr char DefaultCompilerUnixC[]{ "cc" };
 
 /**
  * @brief DefaultMSVCToolchainQueryScript denotes the standard script which prepares environment variables for executing MSVC cl commands.
  *
  * To override this, set a REZ_TOOLCHAIN_QUERY_PATH environment variable.
+ *
+ * On UNIX, REZ_TOOLCHAIN_QUERY_PATH instead names an optional sh script to source, such as a devtoolset enable script, conda activate, or a Yocto environment-setup-* script.
  */
-constexpr char DefaultMSVCToolchainQueryScript[]{ R"(C:\Program Files (x86)\Microsoft Visual Studio\2019\Community\VC\Auxiliary\Build\vcvarsall.bat)" };
+inline constexpr char DefaultMSVCToolchainQueryScript[]{ R"(C:\Program Files (x86)\Microsoft Visual Studio\2019\Community\VC\Auxiliary\Build\vcvarsall.bat)" };
 
 /**
  * @brief ArchitectureMsvcAmd64 denotes the amd64 architecture in MSVC nomenclature.
  */
-constexpr char ArchitectureMsvcAmd64[]{ "x64" };
+inline constexpr char ArchitectureMsvcAmd64[]{ "x64" };
 
 /**
  * @brief Lang denotes a programming language.
@@ -106,6 +371,21 @@ enum class Lang : std::uint8_t {
     C
 };
 
+/**
+ * @brief DelegateMode denotes how the user task definition is built and run.
+ */
+enum class DelegateMode : std::uint8_t {
+    /**
+     * @brief Executable denotes a standalone delegate program, executed in place of rez.
+     */
+    Executable,
+
+    /**
+     * @brief SharedObject denotes a shared library, loaded into the rez process, whose main entrypoint is called directly.
+     */
+    SharedObject
+};
+
 /**
  * @brief << formats a Lang to an ostream.
  *
@@ -124,6 +404,37 @@ std::ostream &operator<<(std::ostream &os, const Lang &o);
  */
 std::filesystem::path ApplyBinaryExtension(const std::filesystem::path &basename, bool windows);
 
+/**
+ * @brief << formats a DelegateMode to an ostream.
+ *
+ * @param os an output stream
+ * @param o a DelegateMode
+ * @returns the output stream result
+ */
+std::ostream &operator<<(std::ostream &os, const DelegateMode &o);
+
+/**
+ * @brief ApplySharedLibraryExtension applies OS-appropriate file extensions to shared libraries.
+ *
+ * @param basename path to a shared library, without any file extension
+ * @param windows whether the context is (COMSPEC) Windows
+ * @returns a copy of the path with the OS-appropriate file extension
+ */
+std::filesystem::path ApplySharedLibraryExtension(const std::filesystem::path &basename, bool windows);
+
+/**
+ * @brief RunSharedObject loads a shared library into the current process and calls its main entrypoint.
+ *
+ * This avoids the process start-up and dynamic linking costs of executing a separate delegate program.
+ *
+ * @param path a shared library path
+ * @param argv arguments to pass to main, including the program name
+ * @returns the exit status from main
+ *
+ * @throws an error when the library cannot be loaded, or lacks a main symbol
+ */
+int RunSharedObject(const std::filesystem::path &path, const std::vector<std::string> &argv);
+
 /**
  * @brief GetEnvironmentVariable retrieves environment variables.
  *
@@ -132,6 +443,241 @@ std::filesystem::path ApplyBinaryExtension(const std::filesystem::path &basename
  */
 std::optional<std::string> GetEnvironmentVariable(const std::string &key);
 
+/**
+ * @brief HashBytes computes a fast, non-cryptographic 64-bit digest (MurmurHash64A).
+ *
+ * @param data a byte buffer
+ * @param size the number of bytes in data
+ * @param seed a starting value, such as the digest of a prior buffer
+ * @returns a digest
+ */
+inline std::uint64_t HashBytes(const char *data, std::size_t size, std::uint64_t seed) {
+    constexpr std::uint64_t m{ 0xc6a4a7935bd1e995ULL };
+    constexpr int r{ 47 };
+    std::uint64_t h{ seed ^ (size * m) };
+
+    const std::size_t blocks{ size / sizeof(std::uint64_t) };
+
+    for (std::size_t i{ 0 }; i < blocks; i++) {
+        std::uint64_t k{ 0 };
+        memcpy(&k, data + i * sizeof(std::uint64_t), sizeof(k));
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    const char *tail{ data + blocks * sizeof(std::uint64_t) };
+
+    switch (size & 7) {
+    case 7:
+        h ^= static_cast<std::uint64_t>(static_cast<unsigned char>(tail[6])) << 48;
+        [[fallthrough]];
+    case 6:
+        h ^= static_cast<std::uint64_t>(static_cast<unsigned char>(tail[5])) << 40;
+        [[fallthrough]];
+    case 5:
+        h ^= static_cast<std::uint64_t>(static_cast<unsigned char>(tail[4])) << 32;
+        [[fallthrough]];
+    case 4:
+        h ^= static_cast<std::uint64_t>(static_cast<unsigned char>(tail[3])) << 24;
+        [[fallthrough]];
+    case 3:
+        h ^= static_cast<std::uint64_t>(static_cast<unsigned char>(tail[2])) << 16;
+        [[fallthrough]];
+    case 2:
+        h ^= static_cast<std::uint64_t>(static_cast<unsigned char>(tail[1])) << 8;
+        [[fallthrough]];
+    case 1:
+        h ^= static_cast<std::uint64_t>(static_cast<unsigned char>(tail[0]));
+        h *= m;
+        break;
+    default:
+        break;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+/**
+ * @brief LargeFileThreshold denotes the size above which @ref HashFile memory maps a file and hashes it in parallel chunks.
+ */
+inline constexpr std::uintmax_t LargeFileThreshold{ 8ULL * 1024 * 1024 };
+
+/**
+ * @brief HashChunkSize denotes the size of each independently hashed chunk of a large file.
+ */
+inline constexpr std::size_t HashChunkSize{ 4ULL * 1024 * 1024 };
+
+/**
+ * @brief HashFile computes a @ref HashBytes digest of a file's contents.
+ *
+ * Files larger than @ref LargeFileThreshold are memory mapped (on POSIX systems) and split into @ref HashChunkSize chunks, hashed concurrently. The chunk digests are then hashed together.
+ *
+ * @param path a file path
+ * @param seed a starting value
+ * @returns a digest
+ *
+ * @throws an error in the event of a problem
+ */
+inline std::uint64_t HashFile(const std::filesystem::path &path, std::uint64_t seed) {
+    std::error_code ec;
+    const std::uintmax_t size{ std::filesystem::file_size(path, ec) };
+
+    if (ec) {
+        throw std::runtime_error("error reading file: " + path.string());
+    }
+
+#if !defined(_WIN32)
+    if (size > LargeFileThreshold) {
+        const int fd{ open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+
+        if (fd == -1) {
+            throw std::runtime_error("error reading file: " + path.string());
+        }
+
+        void *mapping{ mmap(nullptr, static_cast<std::size_t>(size), PROT_READ, MAP_PRIVATE, fd, 0) };
+        close(fd);
+
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("error mapping file: " + path.string());
+        }
+
+        const char *data{ static_cast<const char *>(mapping) };
+        const std::size_t chunks{ static_cast<std::size_t>((size + HashChunkSize - 1) / HashChunkSize) };
+        std::vector<std::uint64_t> digests(chunks);
+        const std::size_t threads{ std::min<std::size_t>(chunks, std::max(std::thread::hardware_concurrency(), 1U)) };
+        std::vector<std::thread> workers;
+
+        for (std::size_t t{ 0 }; t < threads; t++) {
+            workers.emplace_back([&, t] {
+                for (std::size_t i{ t }; i < chunks; i += threads) {
+                    const std::size_t offset{ i * HashChunkSize };
+                    const std::size_t length{ std::min(HashChunkSize, static_cast<std::size_t>(size) - offset) };
+                    digests[i] = HashBytes(data + offset, length, seed);
+                }
+            });
+        }
+
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+
+        munmap(mapping, static_cast<std::size_t>(size));
+        return HashBytes(reinterpret_cast<const char *>(digests.data()), digests.size() * sizeof(std::uint64_t), seed);
+    }
+#endif
+
+    std::ifstream f(path, std::ios::binary);
+
+    if (!f) {
+        throw std::runtime_error("error reading file: " + path.string());
+    }
+
+    std::string contents(static_cast<std::size_t>(size), '\0');
+    f.read(contents.data(), static_cast<std::streamsize>(contents.size()));
+    contents.resize(static_cast<std::size_t>(f.gcount()));
+    return HashBytes(contents.data(), contents.size(), seed);
+}
+
+/**
+ * @brief FindExecutable resolves a command name against PATH (and PATHEXT on Windows).
+ *
+ * Names containing a directory separator are checked as-is.
+ *
+ * @param name a command name, such as "c++"
+ * @param windows whether the context is (COMSPEC) Windows
+ * @returns std::nullopt when no such executable is found
+ */
+std::optional<std::filesystem::path> FindExecutable(const std::string &name, bool windows);
+
+/**
+ * @brief ParseDepfile extracts the prerequisites from a make-style dependency file, as emitted by -MMD -MF.
+ *
+ * Line continuations, escaped spaces, and escaped dollar signs are honored.
+ *
+ * @param contents the text of a dependency file
+ * @returns the prerequisite paths, in order of appearance
+ */
+std::vector<std::filesystem::path> ParseDepfile(const std::string &contents);
+
+/**
+ * @brief ParseSourceDependencies extracts the included headers from a JSON dependency file, as emitted by cl /sourceDependencies.
+ *
+ * @param contents the text of a JSON dependency file
+ * @returns the header paths in the Includes array, in order of appearance
+ */
+std::vector<std::filesystem::path> ParseSourceDependencies(const std::string &contents);
+
+/**
+ * @brief SplitArguments splits a flags string, such as a CXXFLAGS value, into arguments.
+ *
+ * Arguments are separated by whitespace. Single and double quotes group arguments containing whitespace. Backslashes outside of quotes are literal, preserving Windows paths.
+ *
+ * @param s a flags string
+ * @returns the arguments
+ */
+std::vector<std::string> SplitArguments(const std::string &s);
+
+/**
+ * @brief JoinArguments renders an argv for logging.
+ *
+ * @param argv arguments
+ * @returns a space separated string, quoting arguments which contain whitespace or quotes
+ */
+std::string JoinArguments(const std::vector<std::string> &argv);
+
+/**
+ * @brief Spawn launches a process directly (posix_spawnp or _spawnvp), without an intermediate shell, and waits for it to complete.
+ *
+ * @param argv the program name or path, followed by its arguments
+ * @returns the exit status, or 128 plus the signal number for processes terminated by a signal
+ *
+ * @throws an error when the process cannot be launched
+ */
+int Spawn(const std::vector<std::string> &argv);
+
+/**
+ * @brief Exec replaces the current process with another (execvp).
+ *
+ * On Windows, which lacks a true exec, the process is spawned and awaited instead.
+ *
+ * @param argv the program name or path, followed by its arguments
+ * @returns the exit status (Windows only)
+ *
+ * @throws an error when the process cannot be launched
+ */
+int Exec(const std::vector<std::string> &argv);
+
+/**
+ * @brief ExportEnvironmentVariable sets an environment variable for the current process and its children.
+ *
+ * @param key the name of an environment variable
+ * @param value the value
+ *
+ * @throws an error in the event of a problem
+ */
+void ExportEnvironmentVariable(const std::string &key, const std::string &value);
+
+/**
+ * @brief StartJobserver serves a GNU make jobserver token pool to the delegate and its children.
+ *
+ * A pipe is filled with jobs - 1 tokens, and MAKEFLAGS is exported with -j and --jobserver-auth. When MAKEFLAGS already advertises a jobserver, such as when rez runs under make, rez joins that pool as a client instead.
+ *
+ * Unsupported on Windows, where this is a no-op.
+ *
+ * @param jobs the total number of job slots
+ *
+ * @throws an error in the event of a problem
+ */
+void StartJobserver(std::size_t jobs);
+
 /**
  * @brief DetectWindowsEnvironment determines whether the runtime environment is (COMSPEC) Windows.
  *
@@ -144,74 +690,196 @@ std::optional<std::string> GetEnvironmentVariable(const std::string &key);
 bool DetectWindowsEnvironment();
 
 /**
- * @brief Config parameterizes rez builds.
+ * @brief TranslationUnit parameterizes the separate compilation of one source file in a task definition directory.
  */
-struct Config {
-    std::filesystem::path cache_file_path{ std::filesystem::path(CacheDir) / CacheFileBasename };
-
+struct TranslationUnit {
     /**
-     * @brief debug controls whether additional logging is performed. (Default: false)
+     * @brief source_path denotes the source file.
      *
      * Examples:
      *
-     * * false
-     * * true
+     * * std::filesystem::path("rez") / "build.cpp"
      */
-    bool debug{ false };
+    std::filesystem::path source_path{};
 
     /**
-     * @brief windows denotes whether the runtime environment is (COMSPEC) Windows. (Default: Determined at runtime by @ref Load)
+     * @brief object_path denotes the cached object file.
      *
      * Examples:
      *
-     * * false
-     * * true
+     * * std::filesystem::path(".rez") / "obj" / "debug" / "build.cpp.o"
+     * * std::filesystem::path(".rez") / "obj" / "debug" / "build.cpp.obj"
      */
-    bool windows{ false };
+    std::filesystem::path object_path{};
 
     /**
-     * @brief task_definition_path denotes the user's task definition source file. (Default: rez.cpp)
-     *
-     * If no rez.cpp file is present, then rez.c is checked as a fallback.
+     * @brief depfile_path denotes the dependency file which the compiler emits alongside the object.
      *
      * Examples:
      *
-     * * std::filesystem::path("rez.cpp")
-     * * std::filesystem::path("rez.c")
+     * * std::filesystem::path(".rez") / "obj" / "debug" / "build.cpp.d"
+     * * std::filesystem::path(".rez") / "obj" / "debug" / "build.cpp.json"
      */
-    std::filesystem::path task_definition_path{ std::filesystem::path(TaskDefinitionCpp) };
+    std::filesystem::path depfile_path{};
 
     /**
-     * @brief task_definition_lang denotes the programming language for the user's task definition source file. (Default: Lang::Cpp)
+     * @brief manifest_path denotes the file recording the cache key of the current object build.
      *
      * Examples:
      *
-     * * Lang::Cpp
-     * * Lang::C
+     * * std::filesystem::path(".rez") / "obj" / "debug" / "build.cpp.key"
      */
-    Lang task_definition_lang{ Lang::Cpp };
+    std::filesystem::path manifest_path{};
 
     /**
-     * @brief compiler denotes the executable used to build the user task tree. (Default: Determined at runtime by @ref Load)
+     * @brief build_argv denotes the compilation step for the source file. (Default: Determined at runtime by @ref Config::ComposeBuildCommand)
      *
      * Examples:
      *
-     * * "c++"s
-     * * "cc"s
-     * * "cl"s
-     * * "clang++"s
-     * * "clang"s
-     * * "g++"s
-     * * "gcc"s
+     * * std::vector<std::string>{ "c++", "-c", "-o", ".rez/obj/debug/build.cpp.o", "-MMD", "-MF", ".rez/obj/debug/build.cpp.d", "-O0", "rez/build.cpp" }
      */
-    std::string compiler{ std::string(DefaultCompilerUnixCpp) };
+    std::vector<std::string> build_argv{};
+};
 
-    /**
-     * @brief artifact_dir_path denotes the path where rez binaries are housed (Default: std::filesystem::path(CacheDir) / ArtifactDirBasename)
-     *
+/**
+ * @brief Config parameterizes rez builds.
+ */
+struct Config {
+    /**
+     * @brief cache_file_path denotes the binary cache of environment variables captured from a toolchain query script. (Default: std::filesystem::path(CacheDir) / CacheFileBasename)
+     *
+     * The cache is keyed by the query script contents and arguments, plus the calling environment.
+     */
+    std::filesystem::path cache_file_path{ std::filesystem::path(CacheDir) / CacheFileBasename };
+
+    /**
+     * @brief manifest_path denotes the file recording the cache key of the current delegate build. (Default: artifact_dir_path / ManifestFileBasename)
+     */
+    std::filesystem::path manifest_path{ std::filesystem::path(CacheDir) / ManifestFileBasename };
+
+    /**
+     * @brief depfile_path denotes the dependency file which the compiler emits during delegate builds. (Default: Determined at runtime by @ref Load)
+     *
+     * Examples:
+     *
+     * * std::filesystem::path(".rez") / "bin" / "debug" / "rez-deps.d"
+     * * std::filesystem::path(".rez") / "bin" / "release" / "rez-deps.json"
+     */
+    std::filesystem::path depfile_path{ std::filesystem::path(CacheDir) / DepfileBasenameUnix };
+
+    /**
+     * @brief debug controls whether additional logging is performed. (Default: false)
+     *
+     * Examples:
+     *
+     * * false
+     * * true
+     */
+    bool debug{ false };
+
+    /**
+     * @brief windows denotes whether the runtime environment is (COMSPEC) Windows. (Default: Determined at runtime by @ref Load)
+     *
+     * Examples:
+     *
+     * * false
+     * * true
+     */
+    bool windows{ false };
+
+    /**
+     * @brief task_definition_path denotes the user's task definition source file. (Default: rez.cpp)
+     *
+     * If no rez.cpp file is present, then rez.c is checked as a fallback, followed by a rez directory of *.cpp, or else *.c, source files.
+     *
+     * Examples:
+     *
+     * * std::filesystem::path("rez.cpp")
+     * * std::filesystem::path("rez.c")
+     * * std::filesystem::path("rez")
+     */
+    std::filesystem::path task_definition_path{ std::filesystem::path(TaskDefinitionCpp) };
+
+    /**
+     * @brief task_definition_lang denotes the programming language for the user's task definition source file. (Default: Lang::Cpp)
+     *
+     * Examples:
+     *
+     * * Lang::Cpp
+     * * Lang::C
+     */
+    Lang task_definition_lang{ Lang::Cpp };
+
+    /**
+     * @brief compiler denotes the executable used to build the user task tree. (Default: Determined at runtime by @ref Load, or by @ref SelectCompiler when REZ_COMPILER=fastest)
+     *
+     * Examples:
+     *
+     * * "c++"s
+     * * "cc"s
+     * * "cl"s
+     * * "clang++"s
+     * * "clang"s
+     * * "g++"s
+     * * "gcc"s
+     * * "tcc"s
+     */
+    std::string compiler{ std::string(DefaultCompilerUnixCpp) };
+
+    /**
+     * @brief compiler_fingerprint identifies the resolved compiler binary, its version, target, and default language standard. (Default: Determined at runtime by @ref Load)
+     *
+     * Probes are cached in std::filesystem::path(CacheDir) / CompilerFingerprintBasename, and repeated only when the compiler binary's inode, size, or modification time changes.
+     *
+     * Examples:
+     *
+     * * "/usr/bin/x86_64-linux-gnu-g++-12\nc++ (Debian 12.2.0-14) 12.2.0\nx86_64-linux-gnu\n201703L"
+     */
+    std::string compiler_fingerprint{};
+
+    /**
+     * @brief linker_flag selects a fast linker for UNIX delegate links, per REZ_LINKER. (Default: Determined at runtime by @ref FingerprintCompiler)
+     *
+     * Unless REZ_LINKER names a linker, rez prefers mold, then lld, when found in PATH and accepted by the compiler. REZ_LINKER=default keeps the compiler's default linker.
+     *
+     * Examples:
+     *
+     * * "-fuse-ld=mold"
+     * * "-fuse-ld=lld"
+     * * ""
+     */
+    std::string linker_flag{};
+
+    /**
+     * @brief delegate_mode denotes how the user task definition is built and run. (Default: DelegateMode::Executable)
+     *
+     * Set a REZ_DELEGATE_MODE environment variable to "shared" to build the task definition as a shared library, loaded into the rez process. Shared mode is unsupported for cl.
+     *
+     * Examples:
+     *
+     * * DelegateMode::Executable
+     * * DelegateMode::SharedObject
+     */
+    DelegateMode delegate_mode{ DelegateMode::Executable };
+
+    /**
+     * @brief profile denotes the delegate build profile, per REZ_PROFILE. (Default: DefaultProfile)
+     *
+     * Each profile caches its delegate separately, so that switching profiles does not rebuild.
+     *
+     * Examples:
+     *
+     * * "debug"
+     * * "release"
+     */
+    std::string profile{ DefaultProfile };
+
+    /**
+     * @brief artifact_dir_path denotes the path where rez binaries are housed (Default: std::filesystem::path(CacheDir) / ArtifactDirBasename / profile)
+     *
      * Examples:
      *
-     * * std::filesystem::path(".rez") / "bin"
+     * * std::filesystem::path(".rez") / "bin" / "debug"
      */
     std::filesystem::path artifact_dir_path{ std::filesystem::path(CacheDir) / ArtifactDirBasename };
 
@@ -220,20 +888,130 @@ struct Config {
      *
      * Examples:
      *
-     * * std::filesystem::path(".rez") / "bin" / "rez"
-     * * std::filesystem::path(".rez") / "bin" / "rez.exe"
+     * * std::filesystem::path(".rez") / "bin" / "debug" / "delegate-rez"
+     * * std::filesystem::path(".rez") / "bin" / "debug" / "delegate-rez.exe"
+     * * std::filesystem::path(".rez") / "bin" / "release" / "delegate-rez.so"
      */
     std::filesystem::path artifact_file_path{ std::filesystem::path("") };
 
     /**
-     * @brief build_command denotes the compilation step for the user task source file (Default: Determined at runtime by @ref Load)
+     * @brief artifact_temp_file_path denotes where builds write the delegate, before @ref CommitArtifact renames it to artifact_file_path (Default: Determined at runtime by @ref Load)
+     *
+     * Renaming ensures that concurrent rez processes never run a partially written delegate.
+     *
+     * Examples:
+     *
+     * * std::filesystem::path(".rez") / "bin" / "delegate-rez.tmp"
+     * * std::filesystem::path(".rez") / "bin" / "delegate-rez.tmp.exe"
+     */
+    std::filesystem::path artifact_temp_file_path{ std::filesystem::path("") };
+
+    /**
+     * @brief translation_units denotes the separately compiled source files of a task definition directory, or empty for a single task definition file. (Default: Determined at runtime by @ref Load)
+     *
+     * Each source file compiles to its own object, cached under std::filesystem::path(CacheDir) / ObjectDirBasename. build_argv then links the objects.
+     */
+    std::vector<TranslationUnit> translation_units{};
+
+    /**
+     * @brief build_argv denotes the compilation step for the user task source file, or the link step for a task definition directory (Default: Determined at runtime by @ref Load)
+     *
+     * The compiler is launched directly, without an intermediate shell.
+     *
+     * Examples:
+     *
+     * * std::vector<std::string>{ "c++", "-o", ".rez/bin/debug/delegate-rez.tmp", "-MMD", "-MF", ".rez/bin/debug/rez-deps.d", "-O0", "-fuse-ld=mold", "rez.cpp" }
+     * * std::vector<std::string>{ "cl", "/Od", "/sourceDependencies", ".rez\\bin\\debug\\rez-deps.json", "rez.cpp", "/link", "/out:.rez\\bin\\debug\\delegate-rez.tmp.exe" }
+     * * std::vector<std::string>{ "c++", "-o", ".rez/bin/debug/delegate-rez.tmp", "-O0", "-fuse-ld=mold", ".rez/obj/debug/build.cpp.o", ".rez/obj/debug/main.cpp.o" }
+     */
+    std::vector<std::string> build_argv{};
+
+    /**
+     * @brief flags denotes the CPPFLAGS, plus CXXFLAGS or CFLAGS, applied to delegate builds. (Default: Determined at runtime by @ref Load)
+     *
+     * Flags are split per @ref SplitArguments.
+     *
+     * Examples:
+     *
+     * * std::vector<std::string>{ "-O3", "-Werror", "-Wextra", "-Wall", "-pedantic", "-std=c++17" }
+     */
+    std::vector<std::string> flags{};
+
+    /**
+     * @brief pch controls whether delegate builds reuse a precompiled prelude header. (Default: Determined at runtime by @ref Load)
+     *
+     * The prelude covers common standard headers, plus the rez API header when every task definition source includes it directly, per @ref pch_api.
+     *
+     * Set a REZ_PCH environment variable to 0 to disable.
+     *
+     * Precompiled headers are also skipped for task definitions which #define macros before their first #include, such as feature test macros.
+     */
+    bool pch{ false };
+
+    /**
+     * @brief pch_api controls whether the precompiled prelude includes rez/rez.hpp (rez/rez.h for C). (Default: Determined at runtime by @ref Load)
+     *
+     * The prelude is force-included ahead of every source, so the rez API joins it only when every source already includes the API header directly. Other task definitions keep their own name lookup.
+     */
+    bool pch_api{ false };
+
+    /**
+     * @brief pch_dir_path denotes the directory housing the precompiled prelude for the current compiler and flags. (Default: Determined at runtime by @ref Load)
+     *
+     * Examples:
+     *
+     * * std::filesystem::path(".rez") / "pch" / "cpp-0123456789abcdef"
+     */
+    std::filesystem::path pch_dir_path{ std::filesystem::path(CacheDir) / PchDirBasename };
+
+    /**
+     * @brief pch_build_argv denotes the precompilation step for the prelude header, or empty when pch is disabled. (Default: Determined at runtime by @ref Load)
+     *
+     * Examples:
+     *
+     * * std::vector<std::string>{ "c++", "-std=c++17", "-x", "c++-header", "-o", ".rez/pch/cpp-0123456789abcdef/rez-prelude.hpp.gch", ".rez/pch/cpp-0123456789abcdef/rez-prelude.hpp" }
+     */
+    std::vector<std::string> pch_build_argv{};
+
+    /**
+     * @brief module controls whether delegate builds import the rez C++20 module. (Default: Determined at runtime by @ref Load)
+     *
+     * Enabled for C++ task definitions with an `import rez;` declaration, in place of the precompiled prelude.
+     */
+    bool module{ false };
+
+    /**
+     * @brief module_dir_path denotes the directory housing the compiled rez module for the current compiler and flags. (Default: Determined at runtime by @ref Load)
+     *
+     * Examples:
+     *
+     * * std::filesystem::path(".rez") / "modules" / "cpp-0123456789abcdef"
+     */
+    std::filesystem::path module_dir_path{ std::filesystem::path(CacheDir) / ModuleDirBasename };
+
+    /**
+     * @brief module_build_argv denotes the compilation step for the rez module interface, or empty when module is disabled. (Default: Determined at runtime by @ref ComposeBuildCommand)
+     *
+     * The step emits both the compiled module interface and an object file, which delegate builds link.
+     *
+     * Examples:
+     *
+     * * std::vector<std::string>{ "g++", "-std=c++20", "-fmodules-ts", "-fmodule-mapper=.rez/modules/cpp-0123456789abcdef/rez.map", "-x", "c++", "-c", "-o", ".rez/modules/cpp-0123456789abcdef/rez.o", "-MMD", "-MF", ".rez/modules/cpp-0123456789abcdef/rez-module.d", ".rez/modules/cpp-0123456789abcdef/rez.cppm" }
+     * * std::vector<std::string>{ "clang++", "-std=c++20", "-x", "c++-module", "-fmodule-output=.rez/modules/cpp-0123456789abcdef/rez.pcm", "-c", "-o", ".rez/modules/cpp-0123456789abcdef/rez.o", "-MMD", "-MF", ".rez/modules/cpp-0123456789abcdef/rez-module.d", ".rez/modules/cpp-0123456789abcdef/rez.cppm" }
+     */
+    std::vector<std::string> module_build_argv{};
+
+    /**
+     * @brief shared_cache_dir_path denotes a machine-wide store of delegates, shared across checkouts and worktrees, or empty when disabled. (Default: Determined at runtime by @ref Load)
+     *
+     * Set a REZ_SHARED_CACHE environment variable to 1 to enable the default store, or to a directory path. Task definition directories always build locally.
      *
      * Examples:
      *
-     * * "c++ -o .rez/bin/rez rez.cpp"s
-     * * R"(cl rez.cpp /link /out:.rez\bin\rez.exe)"s
+     * * std::filesystem::path("")
+     * * std::filesystem::path("/home/alice/.cache") / "rez"
      */
-    std::string build_command;
+    std::filesystem::path shared_cache_dir_path{};
 
     /**
      * @brief ApplyMSVCToolchain loads MSVC environment variables for cl into the current process.
@@ -244,20 +1022,3360 @@ struct Config {
      */
     void ApplyMSVCToolchain() const;
 
+    /**
+     * @brief ApplyToolchainScript loads the environment variables set by sourcing a UNIX toolchain setup script into the current process.
+     *
+     * The script runs once per change to its contents or to the calling environment. Later runs replay the changed variables from cache_file_path.
+     *
+     * @param script_path an sh script path
+     *
+     * @throws an error in the event of a problem
+     */
+    void ApplyToolchainScript(const std::filesystem::path &script_path) const;
+
     /**
      * @brief Load populates build parameters according to the documented defaults and override mechanisms.
      *
      * @throws an error in the event of a problem
      */
     void Load();
-} __attribute__((aligned(128)));
 
-/**
- * @brief << formats a Config to an ostream.
- *
- * @param os an output stream
- * @param o a Config
- * @returns the output stream result
- */
-std::ostream &operator<<(std::ostream &os, const Config &o);
+    /**
+     * @brief SelectCompiler applies the installed compiler which builds the task definition fastest.
+     *
+     * Each candidate (c++, g++, clang++ for C++; cc, gcc, clang, tcc for C) found in PATH is timed once, building the task definition (or its first translation unit) with the current flags. The fastest successful candidate is cached in CacheDir/CompilerChoiceBasename, until the set of candidates or the flags change. When no candidate succeeds, compiler is left unchanged.
+     *
+     * @throws an error in the event of a problem
+     */
+    void SelectCompiler();
+
+    /**
+     * @brief FingerprintCompiler populates compiler_fingerprint and linker_flag, probing the compiler only when the cached probe is stale.
+     *
+     * @throws an error in the event of a problem
+     */
+    void FingerprintCompiler();
+
+    /**
+     * @brief ComposeBuildCommand populates build_argv, pch_build_argv, and any translation unit build_argv, from the current settings.
+     */
+    void ComposeBuildCommand();
+
+    /**
+     * @brief PrecompiledHeaderSourcePath denotes the empty source file which cl /Yc compiles to generate a precompiled header.
+     *
+     * @returns a path inside of pch_dir_path
+     */
+    std::filesystem::path PrecompiledHeaderSourcePath() const;
+
+    /**
+     * @brief PrecompiledHeaderDependencies reads the dependency file emitted when precompiling the prelude.
+     *
+     * Headers reached only through the prelude, such as rez/rez.hpp, do not appear in delegate dependency files, so cache keys consult these as well.
+     *
+     * @returns the recorded dependencies; or an empty collection when pch is disabled, or no dependency file is present
+     */
+    std::vector<std::filesystem::path> PrecompiledHeaderDependencies() const;
+
+    /**
+     * @brief BuildPrecompiledHeader generates the prelude header and precompiles it, when not already cached.
+     *
+     * A cached precompiled header is rebuilt when any header it recorded has changed.
+     *
+     * On failure, precompiled headers are disabled for the current compiler, flags, and prelude headers, and build_argv is recomposed without them.
+     *
+     * @returns true when the precompiled header is ready for use
+     *
+     * @throws an error in the event of a problem
+     */
+    bool BuildPrecompiledHeader();
+
+    /**
+     * @brief ModuleDependencies reads the dependency file emitted when compiling the rez module.
+     *
+     * @returns the recorded dependencies; or an empty collection when module is disabled, or no dependency file is present
+     */
+    std::vector<std::filesystem::path> ModuleDependencies() const;
+
+    /**
+     * @brief BuildModule generates the rez module interface and compiles it, when not already cached.
+     *
+     * A cached module is rebuilt when any header it recorded, such as rez/rez.hpp, has changed.
+     *
+     * @returns the build exit status, or EXIT_SUCCESS when module is disabled or cached
+     *
+     * @throws an error in the event of a problem
+     */
+    int BuildModule() const;
+
+    /**
+     * @brief CacheKey digests every input that affects the delegate build.
+     *
+     * The key covers the task definition contents, the compiler, the full build_argv, and the compiler_fingerprint.
+     *
+     * The key also covers the contents of every header recorded in the dependency file from the prior build, plus any @ref PrecompiledHeaderDependencies and @ref ModuleDependencies, so edits to headers included by the task definition trigger a rebuild.
+     *
+     * For a task definition directory, the key covers the link step plus the per-object key of every translation unit.
+     *
+     * Unlike comparing modification times, content keys survive git checkouts and rebases, and notice changes to CXX, CPPFLAGS, CXXFLAGS, and CFLAGS.
+     *
+     * @returns a hexadecimal digest
+     *
+     * @throws an error in the event of a problem
+     */
+    std::string CacheKey() const;
+
+    /**
+     * @brief Dependencies reads the dependency file emitted by the prior delegate build.
+     *
+     * @returns the recorded dependencies, excluding the task definition itself; or an empty collection when no dependency file is present
+     */
+    std::vector<std::filesystem::path> Dependencies() const;
+
+    /**
+     * @brief Dependencies reads a dependency file emitted by a prior build.
+     *
+     * @param dependency_file_path a dependency file path
+     * @param source the source file which the dependency file describes
+     * @returns the recorded dependencies, excluding the source itself; or an empty collection when no dependency file is present
+     */
+    std::vector<std::filesystem::path> Dependencies(const std::filesystem::path &dependency_file_path, const std::filesystem::path &source) const;
+
+    /**
+     * @brief BuildInputs lists the files read by a delegate build, as recorded by the prior build.
+     *
+     * @returns the task definition sources, their recorded headers, plus any @ref PrecompiledHeaderDependencies and @ref ModuleDependencies
+     */
+    std::vector<std::filesystem::path> BuildInputs() const;
+
+    /**
+     * @brief DigestInputs digests the paths and contents of files.
+     *
+     * @param inputs files, per @ref BuildInputs
+     * @returns a hexadecimal digest
+     */
+    std::string DigestInputs(const std::vector<std::filesystem::path> &inputs) const;
+
+    /**
+     * @brief InputsChanged detects edits made to the build inputs while a build ran.
+     *
+     * Builds read sources as they change underfoot, such as under watch mode. Such builds must not be recorded under the post-build @ref CacheKey.
+     *
+     * @param inputs the files read by the build, listed before the build started
+     * @param digest the @ref DigestInputs of inputs before the build started
+     * @param since the time at which the build started
+     * @returns true when any of inputs no longer matches digest, or when any header first recorded by the build was modified since
+     */
+    bool InputsChanged(const std::vector<std::filesystem::path> &inputs, const std::string &digest, const std::filesystem::file_time_type &since) const;
+
+    /**
+     * @brief BuildObjects compiles the stale translation units of a task definition directory, in parallel.
+     *
+     * An object is stale when missing, or when its recorded key no longer matches its source, build_argv, recorded headers, and compiler. Objects whose inputs change during compilation are left unrecorded, and so stale. Parallelism follows @ref DefaultJobs.
+     *
+     * @returns EXIT_SUCCESS when every object is up to date; otherwise a failing compiler exit status
+     */
+    int BuildObjects() const;
+
+    /**
+     * @brief ArtifactCacheMiss determines whether the delegate requires (re)building.
+     *
+     * @returns true when the artifact is missing, or the manifest does not match the current @ref CacheKey
+     *
+     * @throws an error in the event of a problem
+     */
+    bool ArtifactCacheMiss() const;
+
+    /**
+     * @brief SharedCacheKey digests the inputs that identify a delegate before any headers are known.
+     *
+     * The key covers the task definition contents, the compiler, the full build_argv, and the compiler_fingerprint. Shared store entries under one SharedCacheKey are told apart by their full @ref CacheKey.
+     *
+     * @returns a hexadecimal digest
+     *
+     * @throws an error in the event of a problem
+     */
+    std::string SharedCacheKey() const;
+
+    /**
+     * @brief RestoreSharedArtifact links a matching delegate from the shared store into artifact_file_path, recording its cache key.
+     *
+     * Artifacts are hard linked when possible, and copied otherwise.
+     *
+     * @returns true on a shared store hit
+     *
+     * @throws an error in the event of a problem
+     */
+    bool RestoreSharedArtifact() const;
+
+    /**
+     * @brief PublishSharedArtifact adds the freshly built delegate to the shared store.
+     *
+     * Entries appear atomically, so concurrent publishers and readers never observe partial entries.
+     *
+     * @throws an error in the event of a problem
+     */
+    void PublishSharedArtifact() const;
+
+    /**
+     * @brief CommitArtifact atomically replaces artifact_file_path with a freshly built artifact_temp_file_path.
+     *
+     * @throws an error in the event of a problem
+     */
+    void CommitArtifact() const;
+
+    /**
+     * @brief SaveCacheKey records the current @ref CacheKey to the manifest, after a successful build.
+     *
+     * @throws an error in the event of a problem
+     */
+    void SaveCacheKey() const;
+
+    /**
+     * @brief ForgetCacheKey removes the manifest, so that the next run rebuilds the delegate.
+     *
+     * @throws an error in the event of a problem
+     */
+    void ForgetCacheKey() const;
+} __attribute__((aligned(128)));
+
+/**
+ * @brief << formats a Config to an ostream.
+ *
+ * @param os an output stream
+ * @param o a Config
+ * @returns the output stream result
+ */
+std::ostream &operator<<(std::ostream &os, const Config &o);
+
+/**
+ * @brief WatchDebounce denotes the quiet period that ends a burst of file changes.
+ */
+inline constexpr std::chrono::milliseconds WatchDebounce{ 200 };
+
+/**
+ * @brief Watcher reports changes to files and directory trees.
+ *
+ * Linux uses inotify. Other platforms poll modification times every WatchDebounce.
+ *
+ * Hidden directories, such as .rez and .git, are skipped when watching trees.
+ */
+class Watcher {
+public:
+    /**
+     * @brief Watcher constructs an empty watch set.
+     *
+     * @throws an error in the event of a problem
+     */
+    Watcher();
+
+    Watcher(const Watcher &) = delete;
+    Watcher &operator=(const Watcher &) = delete;
+    Watcher(Watcher &&) = delete;
+    Watcher &operator=(Watcher &&) = delete;
+
+    /**
+     * @brief ~Watcher releases any watches.
+     */
+    ~Watcher();
+
+    /**
+     * @brief Add watches a file, or a directory tree.
+     *
+     * Files are watched by way of their parent directory, so that editors which save by renaming are observed.
+     *
+     * Missing paths are ignored.
+     *
+     * @param path a file or directory path
+     *
+     * @throws an error in the event of a problem
+     */
+    void Add(const std::filesystem::path &path);
+
+    /**
+     * @brief Wait blocks until one or more watched paths change, and then remain quiet for the debounce period.
+     *
+     * @param debounce the quiet period
+     * @returns the absolute paths which changed
+     *
+     * @throws an error in the event of a problem
+     */
+    std::vector<std::filesystem::path> Wait(std::chrono::milliseconds debounce);
+
+    /**
+     * @brief Drain discards pending changes, such as files written by tasks.
+     *
+     * @throws an error in the event of a problem
+     */
+    void Drain();
+
+private:
+    bool Relevant(const std::filesystem::path &path) const;
+
+    void AddDirectory(const std::filesystem::path &path);
+
+    bool Collect(std::set<std::filesystem::path> &changes, int timeout_ms);
+
+    int fd_{ -1 };
+
+    std::map<int, std::filesystem::path> directories_{};
+
+    std::set<std::filesystem::path> files_{};
+
+    std::set<std::filesystem::path> trees_{};
+
+    std::map<std::filesystem::path, std::filesystem::file_time_type> stamps_{};
+};
+
+/**
+ * @brief ServerRequest denotes a delegate run which a rez client forwards to a rez server.
+ */
+struct ServerRequest {
+    /**
+     * @brief args denotes the task arguments.
+     */
+    std::vector<std::string> args{};
+
+    /**
+     * @brief environment denotes the client environment, as KEY=VALUE pairs.
+     */
+    std::vector<std::string> environment{};
+
+    /**
+     * @brief cwd denotes the client working directory.
+     */
+    std::filesystem::path cwd{};
+
+    /**
+     * @brief environment_digest denotes the client's @ref ConfigEnvironmentDigest.
+     */
+    std::string environment_digest{};
+
+    /**
+     * @brief fds denotes the client standard input, output, and error descriptors, received by the server.
+     */
+    std::vector<int> fds{};
+};
+
+/**
+ * @brief ServerSocket listens for rez clients on a unix domain socket, readable only by the current user.
+ *
+ * Unsupported on Windows.
+ */
+class ServerSocket {
+public:
+    /**
+     * @brief ServerSocket binds and listens, replacing any stale socket file.
+     *
+     * @param path a socket path
+     *
+     * @throws an error when another server already listens, or in the event of a problem
+     */
+    explicit ServerSocket(std::filesystem::path path);
+
+    ServerSocket(const ServerSocket &) = delete;
+    ServerSocket &operator=(const ServerSocket &) = delete;
+    ServerSocket(ServerSocket &&) = delete;
+    ServerSocket &operator=(ServerSocket &&) = delete;
+
+    /**
+     * @brief ~ServerSocket stops listening, and removes the socket file.
+     */
+    ~ServerSocket();
+
+    /**
+     * @brief Accept waits for the next well formed client request.
+     *
+     * @param request populated with the request, whose descriptors the caller then owns
+     * @returns a connection descriptor, for @ref ServeRequest or @ref DeclineRequest, or -1 once @ref Stop is called
+     *
+     * @throws an error in the event of a problem
+     */
+    int Accept(ServerRequest &request) const;
+
+    /**
+     * @brief Stop wakes @ref Accept, from any thread, so that the accepting thread may shut the server down.
+     */
+    void Stop() const;
+
+private:
+    std::filesystem::path path_{};
+
+    int fd_{ -1 };
+
+    int stop_fds_[2]{ -1, -1 };
+};
+
+/**
+ * @brief ServeRequest runs a command on behalf of a rez client, relaying its exit status.
+ *
+ * The command is spawned with posix_spawn, which remains safe in multithreaded servers. The command inherits the client working directory, environment, and standard streams. Should the client disconnect, such as on Ctrl+C, the command is terminated.
+ *
+ * @param connection a connection from @ref ServerSocket::Accept, closed on return
+ * @param request the request, whose descriptors are closed on return
+ * @param argv the command, beginning with an executable path
+ * @returns the exit status, or 128 plus the signal number for processes terminated by a signal
+ */
+int ServeRequest(int connection, const ServerRequest &request, const std::vector<std::string> &argv);
+
+/**
+ * @brief DeclineRequest asks a rez client to run its tasks itself, such as while the server's delegate fails to build.
+ *
+ * @param connection a connection from @ref ServerSocket::Accept, closed on return
+ * @param request the request, whose descriptors are closed on return
+ */
+void DeclineRequest(int connection, const ServerRequest &request);
+
+/**
+ * @brief ConfigEnvironmentDigest digests the environment variables which shape @ref Config::Load, along with the toolchain script they name.
+ *
+ * A rez server declines clients whose digest differs from its own, as their tasks would otherwise run a delegate built for another configuration.
+ *
+ * Call before @ref Config::Load, which exports toolchain script results.
+ *
+ * @returns a digest
+ */
+std::string ConfigEnvironmentDigest();
+
+/**
+ * @brief ForwardToServer runs tasks through a rez server, when one listens.
+ *
+ * The current working directory, environment, and standard streams pass to the server.
+ *
+ * @param socket_path a socket path
+ * @param args task arguments
+ * @param environment_digest the client's @ref ConfigEnvironmentDigest
+ * @returns the delegate exit status, or std::nullopt when no server accepts the request
+ */
+std::optional<int> ForwardToServer(const std::filesystem::path &socket_path, const std::vector<std::string> &args, const std::string &environment_digest);
+
+/**
+ * @brief CurrentProcessId queries the process ID.
+ *
+ * @returns the process ID
+ */
+inline long CurrentProcessId() {
+#if defined(_WIN32)
+    return static_cast<long>(_getpid());
+#else
+    return static_cast<long>(getpid());
+#endif
+}
+
+/**
+ * @brief TraceFileEnvironmentVariable names the environment variable which `rez -p <file>` exports, so that nested processes append to the same trace.
+ */
+inline constexpr char TraceFileEnvironmentVariable[]{ "REZ_TRACE_FILE" };
+
+/**
+ * @brief Trace appends Chrome trace events (chrome://tracing, Perfetto) to the file named by REZ_TRACE_FILE, if any.
+ *
+ * The file uses the JSON Array Format, which permits omitting the closing bracket, so that rez, the delegate, and nested rez invocations may all append to it concurrently.
+ */
+class Trace {
+public:
+    /**
+     * @brief Instance accesses the trace for the current process.
+     *
+     * @returns the shared trace
+     */
+    static Trace &Instance() {
+        static Trace instance;
+        return instance;
+    }
+
+    Trace(const Trace &) = delete;
+    Trace &operator=(const Trace &) = delete;
+    Trace(Trace &&) = delete;
+    Trace &operator=(Trace &&) = delete;
+    ~Trace() = default;
+
+    /**
+     * @brief Enabled determines whether events are recorded.
+     *
+     * @returns true when REZ_TRACE_FILE named a writable file at startup
+     */
+    bool Enabled() const {
+        return enabled_;
+    }
+
+    /**
+     * @brief Now queries the trace clock.
+     *
+     * Wall clock time is shared across processes, unlike some steady clocks.
+     *
+     * @returns microseconds since the UNIX epoch
+     */
+    static std::int64_t Now() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief Complete records a complete ("X") event for the current process and thread.
+     *
+     * @param name the event name
+     * @param category the event category
+     * @param start the start time, per @ref Now
+     * @param duration the duration in microseconds
+     */
+    void Complete(std::string_view name, std::string_view category, std::int64_t start, std::int64_t duration) {
+        if (!enabled_) {
+            return;
+        }
+
+        const std::string event{ "{\"name\":\"" + Escape(name) + "\",\"cat\":\"" + Escape(category) + "\",\"ph\":\"X\",\"ts\":" + std::to_string(start) + ",\"dur\":" + std::to_string(duration) + ",\"pid\":" + std::to_string(CurrentProcessId()) + ",\"tid\":" + std::to_string(ThreadId()) + "},\n" };
+
+        // Each event is a single append, so that concurrent processes do not interleave partial lines.
+        const std::lock_guard<std::mutex> lock(mutex_);
+        file_ << event << std::flush;
+    }
+
+private:
+    Trace() {
+        // Avoid GetEnvironmentVariable, which is only available when linking rez itself.
+        const char *path{ getenv(TraceFileEnvironmentVariable) };
+
+        if (path != nullptr && *path != '\0') {
+            file_.open(path, std::ios::app);
+            enabled_ = file_.is_open();
+        }
+    }
+
+    static std::string Escape(std::string_view s) {
+        std::string escaped;
+
+        for (const char c : s) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+                escaped += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                escaped += ' ';
+            } else {
+                escaped += c;
+            }
+        }
+
+        return escaped;
+    }
+
+    static std::size_t ThreadId() {
+        static std::atomic<std::size_t> next{ 1 };
+        static thread_local const std::size_t id{ next++ };
+        return id;
+    }
+
+    std::ofstream file_{};
+    std::mutex mutex_{};
+    bool enabled_{ false };
+};
+
+/**
+ * @brief Span records a trace event covering its own lifetime.
+ *
+ * Spans are cheap no-ops unless tracing is enabled with `rez -p <file>`.
+ *
+ * Example:
+ *
+ * @code
+ * int lint() {
+ *     const rez::Span span("lint");
+ *     return rez::Run({ "cppcheck", "." }).Wait();
+ * }
+ * @endcode
+ */
+class Span {
+public:
+    /**
+     * @brief Span starts a span.
+     *
+     * @param name the span name
+     * @param category the span category
+     */
+    explicit Span(std::string name, std::string category = "task") : name_(std::move(name)), category_(std::move(category)), start_(Trace::Now()) {}
+
+    Span(const Span &) = delete;
+    Span &operator=(const Span &) = delete;
+    Span(Span &&) = delete;
+    Span &operator=(Span &&) = delete;
+
+    /**
+     * @brief ~Span ends the span, recording it.
+     */
+    ~Span() {
+        Trace &trace = Trace::Instance();
+
+        if (trace.Enabled()) {
+            trace.Complete(name_, category_, start_, Trace::Now() - start_);
+        }
+    }
+
+private:
+    std::string name_;
+    std::string category_;
+    std::int64_t start_;
+};
+
+/**
+ * @brief HistoryFileEnvironmentVariable names the environment variable which rez exports to the delegate, so that task graphs append task durations to the run history.
+ */
+inline constexpr char HistoryFileEnvironmentVariable[]{ "REZ_HISTORY_FILE" };
+
+/**
+ * @brief HistoryStartEnvironmentVariable names the environment variable in which rez exports the start time and CPU time of a delegate run, per @ref Trace::Now and @ref ProcessCpuTime, separated by a space, before replacing itself with the delegate. @ref TaskGraph::Main then records the whole run on exit.
+ */
+inline constexpr char HistoryStartEnvironmentVariable[]{ "REZ_HISTORY_START" };
+
+/**
+ * @brief HistoryBasename denotes the file name of the run history, inside CacheDir.
+ */
+inline constexpr char HistoryBasename[]{ "rez-history.bin" };
+
+/**
+ * @brief HistoryCompactionSize denotes the history file size, in bytes, beyond which rez compacts the history.
+ */
+inline constexpr std::uintmax_t HistoryCompactionSize{ 1024 * 1024 };
+
+/**
+ * @brief HistoryKeep denotes the number of most recent records per name which survive compaction.
+ */
+inline constexpr std::size_t HistoryKeep{ 200 };
+
+/**
+ * @brief HistoryRecord denotes one timed delegate run or task.
+ */
+struct HistoryRecord {
+    /**
+     * @brief name denotes a task name, or rez followed by the task arguments for a delegate run.
+     */
+    std::string name{};
+
+    /**
+     * @brief start denotes the start time, per @ref Trace::Now.
+     */
+    std::int64_t start{ 0 };
+
+    /**
+     * @brief wall denotes the elapsed time in microseconds.
+     */
+    std::int64_t wall{ 0 };
+
+    /**
+     * @brief cpu denotes the user plus system CPU time in microseconds, per @ref ProcessCpuTime. Zero where unavailable.
+     */
+    std::int64_t cpu{ 0 };
+
+    /**
+     * @brief status denotes the exit status.
+     */
+    std::int32_t status{ 0 };
+};
+
+/**
+ * @brief ProcessCpuTime queries the CPU time consumed so far by the current process and its awaited children.
+ *
+ * Differences between two queries attribute concurrent work to both intervals, so task CPU times are exact only for tasks which run alone.
+ *
+ * @returns user plus system time in microseconds; or zero on Windows
+ */
+inline std::int64_t ProcessCpuTime() {
+#if defined(_WIN32)
+    return 0;
+#else
+    std::int64_t total{ 0 };
+
+    for (const int who : { RUSAGE_SELF, RUSAGE_CHILDREN }) {
+        struct rusage usage {};
+
+        if (getrusage(who, &usage) == 0) {
+            total += static_cast<std::int64_t>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+        }
+    }
+
+    return total;
+#endif
+}
+
+/**
+ * @brief History appends timed runs to an append-only binary log, for `rez --stats`.
+ *
+ * Each record is a single append, so that concurrent processes do not interleave partial records:
+ *
+ * "RZH1", u32 size of the remainder, i64 start, i64 wall, i64 cpu, i32 status, then the name bytes, in native byte order.
+ */
+class History {
+public:
+    /**
+     * @brief Instance accesses the history for the current process.
+     *
+     * @returns the shared history
+     */
+    static History &Instance() {
+        static History instance;
+        return instance;
+    }
+
+    History(const History &) = delete;
+    History &operator=(const History &) = delete;
+    History(History &&) = delete;
+    History &operator=(History &&) = delete;
+    ~History() = default;
+
+    /**
+     * @brief Enabled determines whether runs are recorded.
+     *
+     * @returns true when REZ_HISTORY_FILE named a writable file at startup
+     */
+    bool Enabled() const {
+        return enabled_;
+    }
+
+    /**
+     * @brief Encode serializes a record.
+     *
+     * @param record a record
+     * @returns the record bytes
+     */
+    static std::string Encode(const HistoryRecord &record) {
+        const std::uint32_t size{ static_cast<std::uint32_t>(3 * sizeof(std::int64_t) + sizeof(std::int32_t) + record.name.size()) };
+        std::string bytes{ "RZH1" };
+        bytes.append(reinterpret_cast<const char *>(&size), sizeof(size));
+        bytes.append(reinterpret_cast<const char *>(&record.start), sizeof(record.start));
+        bytes.append(reinterpret_cast<const char *>(&record.wall), sizeof(record.wall));
+        bytes.append(reinterpret_cast<const char *>(&record.cpu), sizeof(record.cpu));
+        bytes.append(reinterpret_cast<const char *>(&record.status), sizeof(record.status));
+        bytes += record.name;
+        return bytes;
+    }
+
+    /**
+     * @brief Append records a run.
+     *
+     * @param record a record
+     */
+    void Append(const HistoryRecord &record) {
+        if (!enabled_) {
+            return;
+        }
+
+        const std::string bytes{ Encode(record) };
+        const std::lock_guard<std::mutex> lock(mutex_);
+        file_.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        file_.flush();
+    }
+
+    /**
+     * @brief AppendRun records a whole delegate run, when rez replaced itself with the delegate.
+     *
+     * @param args task arguments
+     * @param status the exit status
+     */
+    void AppendRun(const std::vector<std::string> &args, int status) {
+        if (run_start_ <= 0) {
+            return;
+        }
+
+        std::string name{ "rez" };
+
+        for (const std::string &arg : args) {
+            name += " ";
+            name += arg;
+        }
+
+        // Process CPU time survives exec, so discount the time rez spent preparing the delegate.
+        Append(HistoryRecord{ name, run_start_, Trace::Now() - run_start_, ProcessCpuTime() - run_cpu_start_, status });
+    }
+
+private:
+    History() {
+        // Avoid GetEnvironmentVariable, which is only available when linking rez itself.
+        const char *path{ getenv(HistoryFileEnvironmentVariable) };
+
+        if (path != nullptr && *path != '\0') {
+            file_.open(path, std::ios::app | std::ios::binary);
+            enabled_ = file_.is_open();
+        }
+
+        const char *run_start_s{ getenv(HistoryStartEnvironmentVariable) };
+
+        if (run_start_s != nullptr) {
+            char *end{ nullptr };
+            run_start_ = std::strtoll(run_start_s, &end, 10);
+            run_cpu_start_ = std::strtoll(end, nullptr, 10);
+        }
+    }
+
+    std::ofstream file_{};
+    std::mutex mutex_{};
+    bool enabled_{ false };
+    std::int64_t run_start_{ 0 };
+    std::int64_t run_cpu_start_{ 0 };
+};
+
+/**
+ * @brief ReadHistory parses a history file, stopping at the first malformed record, such as a torn final append.
+ *
+ * @param path a history file, which need not exist
+ * @returns records, in append order
+ */
+std::vector<HistoryRecord> ReadHistory(const std::filesystem::path &path);
+
+/**
+ * @brief CompactHistory rewrites a history file, keeping the HistoryKeep most recent records per name.
+ *
+ * Records appended by other processes while the file is rewritten may be lost.
+ *
+ * @param path a history file
+ *
+ * @throws an error in the event of a problem
+ */
+void CompactHistory(const std::filesystem::path &path);
+
+/**
+ * @brief FileLock holds an exclusive advisory lock on a file, across processes, for its lifetime.
+ *
+ * Locks are not reentrant: a process must not lock the same file twice at once. Child processes do not inherit the lock.
+ *
+ * Example:
+ *
+ * @code
+ * const rez::FileLock lock(std::filesystem::path(".rez") / "deploy.lock");
+ * @endcode
+ */
+class FileLock {
+public:
+    /**
+     * @brief FileLock blocks until the lock is acquired.
+     *
+     * @param path a lock file path, created as needed
+     *
+     * @throws an error in the event of a problem
+     */
+    explicit FileLock(const std::filesystem::path &path) {
+        if (path.has_parent_path()) {
+            std::filesystem::create_directories(path.parent_path());
+        }
+
+#if defined(_WIN32)
+        fd_ = _open(path.string().c_str(), _O_RDWR | _O_CREAT | _O_NOINHERIT, _S_IREAD | _S_IWRITE);
+#else
+        fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+#endif
+
+        if (fd_ < 0) {
+            throw std::runtime_error("error opening lock file: " + path.string() + " errno: " + std::to_string(errno));
+        }
+
+        for (;;) {
+#if defined(_WIN32)
+            // _LK_LOCK gives up after ten one second retries.
+            if (_locking(fd_, _LK_LOCK, 1) == 0) {
+                return;
+            }
+
+            if (errno == EDEADLOCK) {
+                continue;
+            }
+#else
+            if (flock(fd_, LOCK_EX) == 0) {
+                return;
+            }
+
+            if (errno == EINTR) {
+                continue;
+            }
+#endif
+            const int err{ errno };
+            Close();
+            throw std::runtime_error("error locking file: " + path.string() + " errno: " + std::to_string(err));
+        }
+    }
+
+    FileLock(const FileLock &) = delete;
+    FileLock &operator=(const FileLock &) = delete;
+    FileLock(FileLock &&) = delete;
+    FileLock &operator=(FileLock &&) = delete;
+
+    /**
+     * @brief ~FileLock releases the lock.
+     */
+    ~FileLock() {
+        Close();
+    }
+
+private:
+    void Close() {
+        if (fd_ < 0) {
+            return;
+        }
+
+#if defined(_WIN32)
+        _lseek(fd_, 0, SEEK_SET);
+        _locking(fd_, _LK_UNLCK, 1);
+        _close(fd_);
+#else
+        // Closing the descriptor releases the flock.
+        close(fd_);
+#endif
+        fd_ = -1;
+    }
+
+    int fd_{ -1 };
+};
+
+/**
+ * @brief ThreadPool runs jobs on a fixed set of worker threads, with work stealing.
+ *
+ * Each worker owns a deque. Jobs submitted from a worker land on that worker's deque, and are popped LIFO for cache locality. Idle workers steal FIFO from the other deques.
+ *
+ * Jobs may submit further jobs.
+ */
+class ThreadPool {
+public:
+    /**
+     * @brief ThreadPool starts workers.
+     *
+     * @param workers the number of worker threads (minimum 1)
+     */
+    explicit ThreadPool(std::size_t workers) {
+        workers = std::max(workers, static_cast<std::size_t>(1));
+
+        for (std::size_t i{ 0 }; i < workers; i++) {
+            queues_.push_back(std::make_unique<Queue>());
+        }
+
+        for (std::size_t i{ 0 }; i < workers; i++) {
+            threads_.emplace_back([this, i] { Work(i); });
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    ThreadPool(ThreadPool &&) = delete;
+    ThreadPool &operator=(ThreadPool &&) = delete;
+
+    /**
+     * @brief ~ThreadPool waits for outstanding jobs, then stops workers.
+     */
+    ~ThreadPool() {
+        Wait();
+
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+
+        work_cv_.notify_all();
+
+        for (std::thread &thread : threads_) {
+            thread.join();
+        }
+    }
+
+    /**
+     * @brief Submit enqueues a job.
+     *
+     * @param job a job
+     */
+    void Submit(std::function<void()> job) {
+        {
+            // Count the job only once it is poppable, so that woken workers find it. Workers uncount jobs under mutex_, after popping.
+            const std::lock_guard<std::mutex> lock(mutex_);
+            const std::size_t i{ CurrentPool() == this ? CurrentWorker() : next_++ % queues_.size() };
+
+            {
+                Queue &queue = *queues_[i];
+                const std::lock_guard<std::mutex> queue_lock(queue.mutex);
+                queue.jobs.push_back(std::move(job));
+            }
+
+            pending_++;
+            queued_++;
+        }
+
+        work_cv_.notify_one();
+    }
+
+    /**
+     * @brief Wait blocks until every submitted job, including jobs submitted by jobs, completes.
+     */
+    void Wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_cv_.wait(lock, [this] { return pending_ == 0; });
+    }
+
+    /**
+     * @brief Size queries the number of workers.
+     *
+     * @returns the number of worker threads
+     */
+    std::size_t Size() const {
+        return threads_.size();
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex{};
+        std::deque<std::function<void()>> jobs{};
+    };
+
+    static const ThreadPool *&CurrentPool() {
+        static thread_local const ThreadPool *pool{ nullptr };
+        return pool;
+    }
+
+    static std::size_t &CurrentWorker() {
+        static thread_local std::size_t worker{ 0 };
+        return worker;
+    }
+
+    bool TryPop(std::size_t i, std::function<void()> &job) {
+        {
+            Queue &own = *queues_[i];
+            const std::lock_guard<std::mutex> lock(own.mutex);
+
+            if (!own.jobs.empty()) {
+                job = std::move(own.jobs.back());
+                own.jobs.pop_back();
+                return true;
+            }
+        }
+
+        for (std::size_t k{ 1 }; k < queues_.size(); k++) {
+            Queue &victim = *queues_[(i + k) % queues_.size()];
+            const std::lock_guard<std::mutex> lock(victim.mutex);
+
+            if (!victim.jobs.empty()) {
+                job = std::move(victim.jobs.front());
+                victim.jobs.pop_front();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void Work(std::size_t i) {
+        CurrentPool() = this;
+        CurrentWorker() = i;
+
+        for (;;) {
+            std::function<void()> job;
+
+            if (TryPop(i, job)) {
+                {
+                    const std::lock_guard<std::mutex> lock(mutex_);
+                    queued_--;
+                }
+
+                job();
+
+                const std::lock_guard<std::mutex> lock(mutex_);
+
+                if (--pending_ == 0) {
+                    idle_cv_.notify_all();
+                }
+
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_cv_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+
+            if (stopping_ && queued_ == 0) {
+                return;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues_{};
+    std::vector<std::thread> threads_{};
+    std::mutex mutex_{};
+    std::condition_variable work_cv_{};
+    std::condition_variable idle_cv_{};
+    std::size_t pending_{ 0 };
+    std::size_t queued_{ 0 };
+    std::size_t next_{ 0 };
+    bool stopping_{ false };
+};
+
+/**
+ * @brief DefaultJobs determines the parallelism for task graphs.
+ *
+ * rez -j N exports a REZ_JOBS environment variable to the delegate.
+ *
+ * @returns REZ_JOBS when set to a positive integer, otherwise the -j value advertised in MAKEFLAGS by a parent make, otherwise the hardware concurrency
+ */
+inline std::size_t DefaultJobs() {
+    // Avoid GetEnvironmentVariable, which is only available when linking rez itself.
+    const char *jobs_s{ getenv("REZ_JOBS") };
+
+    if (jobs_s != nullptr) {
+        const long jobs{ strtol(jobs_s, nullptr, 10) };
+
+        if (jobs > 0) {
+            return static_cast<std::size_t>(jobs);
+        }
+    }
+
+    const char *makeflags_s{ getenv("MAKEFLAGS") };
+
+    if (makeflags_s != nullptr) {
+        const std::string makeflags{ makeflags_s };
+        const std::size_t i{ makeflags.find("-j") };
+
+        if (i != std::string::npos && (i == 0 || makeflags[i - 1] == ' ')) {
+            const long jobs{ strtol(makeflags.c_str() + i + 2, nullptr, 10) };
+
+            if (jobs > 0) {
+                return static_cast<std::size_t>(jobs);
+            }
+        }
+    }
+
+    return std::max(std::thread::hardware_concurrency(), 1U);
+}
+
+/**
+ * @brief JobserverClient shares a GNU make jobserver token pool, when one is advertised in MAKEFLAGS.
+ *
+ * Every process implicitly owns one job slot. Additional concurrent jobs must each hold a token read from the jobserver, and return it when done. Nested make, ninja, and cmake --build processes draw from the same pool, so parallel tasks do not oversubscribe the machine.
+ *
+ * Both the pipe (--jobserver-auth=R,W or --jobserver-fds=R,W) and fifo (--jobserver-auth=fifo:PATH) styles are understood. On Windows, or when MAKEFLAGS advertises no jobserver, Acquire never blocks.
+ */
+class JobserverClient {
+public:
+    /**
+     * @brief JobserverClient connects to the jobserver named in MAKEFLAGS, if any.
+     */
+    JobserverClient() {
+#if !defined(_WIN32)
+        const char *makeflags_s{ getenv("MAKEFLAGS") };
+
+        if (makeflags_s == nullptr) {
+            return;
+        }
+
+        const std::string makeflags{ makeflags_s };
+        std::string auth;
+
+        for (const char *option : { "--jobserver-auth=", "--jobserver-fds=" }) {
+            const std::size_t i{ makeflags.rfind(option) };
+
+            if (i != std::string::npos) {
+                const std::size_t start{ i + strlen(option) };
+                auth = makeflags.substr(start, makeflags.find(' ', start) - start);
+                break;
+            }
+        }
+
+        if (auth.rfind("fifo:", 0) == 0) {
+            read_fd_ = open(auth.substr(5).c_str(), O_RDWR | O_CLOEXEC);
+            write_fd_ = read_fd_;
+            owns_fds_ = read_fd_ != -1;
+        } else if (auth.find(',') != std::string::npos) {
+            read_fd_ = atoi(auth.c_str());
+            write_fd_ = atoi(auth.c_str() + auth.find(',') + 1);
+
+            // make withholds the pipe from recipes not marked as recursive (+).
+            if (fcntl(read_fd_, F_GETFD) == -1 || fcntl(write_fd_, F_GETFD) == -1) {
+                read_fd_ = -1;
+                write_fd_ = -1;
+            }
+        }
+#endif
+    }
+
+    JobserverClient(const JobserverClient &) = delete;
+    JobserverClient &operator=(const JobserverClient &) = delete;
+    JobserverClient(JobserverClient &&) = delete;
+    JobserverClient &operator=(JobserverClient &&) = delete;
+
+    /**
+     * @brief ~JobserverClient disconnects from a fifo jobserver.
+     */
+    ~JobserverClient() {
+#if !defined(_WIN32)
+        if (owns_fds_) {
+            close(read_fd_);
+        }
+#endif
+    }
+
+    /**
+     * @brief Available queries whether a jobserver is connected.
+     *
+     * @returns true when tokens are drawn from a jobserver
+     */
+    bool Available() const {
+        return read_fd_ != -1;
+    }
+
+    /**
+     * @brief Acquire claims a job slot, blocking until one is free.
+     *
+     * @returns a token to pass to @ref Release: -1 denotes the implicit slot, and -2 denotes no token, when no jobserver is connected or the jobserver failed
+     */
+    int Acquire() {
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+
+            if (!implicit_taken_) {
+                implicit_taken_ = true;
+                return -1;
+            }
+        }
+
+#if !defined(_WIN32)
+        if (Available()) {
+            unsigned char token{ 0 };
+
+            for (;;) {
+                const ssize_t n{ read(read_fd_, &token, 1) };
+
+                if (n == 1) {
+                    return token;
+                }
+
+                if (n == -1 && errno == EINTR) {
+                    continue;
+                }
+
+                if (n == -1 && errno == EAGAIN) {
+                    pollfd pfd{ read_fd_, POLLIN, 0 };
+                    poll(&pfd, 1, -1);
+                    continue;
+                }
+
+                break;
+            }
+        }
+#endif
+        // Without a jobserver, concurrency is bounded by the caller alone. Release must not return a token never taken.
+        return -2;
+    }
+
+    /**
+     * @brief Release returns a job slot.
+     *
+     * @param token the result of a prior @ref Acquire
+     */
+    void Release(int token) {
+        if (token == -1) {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            implicit_taken_ = false;
+            return;
+        }
+
+        if (token < 0) {
+            return;
+        }
+
+#if !defined(_WIN32)
+        if (Available()) {
+            const auto byte{ static_cast<unsigned char>(token) };
+
+            while (write(write_fd_, &byte, 1) == -1 && errno == EINTR) {
+            }
+        }
+#endif
+    }
+
+private:
+    std::mutex mutex_{};
+    bool implicit_taken_{ false };
+    bool owns_fds_{ false };
+    int read_fd_{ -1 };
+    int write_fd_{ -1 };
+};
+
+/**
+ * @brief Task denotes a named unit of work, with prerequisites.
+ */
+struct Task {
+    /**
+     * @brief name identifies the task on the command line.
+     */
+    std::string name{};
+
+    /**
+     * @brief dependencies names the tasks which must succeed before this task runs.
+     */
+    std::vector<std::string> dependencies{};
+
+    /**
+     * @brief run performs the work, returning a POSIX-style exit status.
+     */
+    std::function<int()> run{};
+};
+
+/**
+ * @brief TaskGraph runs tasks in dependency order.
+ *
+ * Each task runs at most once per TaskGraph, no matter how many requested tasks depend on it. Independent branches run concurrently on a @ref ThreadPool.
+ *
+ * Under a GNU make jobserver (e.g. rez -j N, or a recursive make recipe), each concurrent task beyond the first holds a jobserver token. See @ref JobserverClient.
+ *
+ * Example:
+ *
+ * @code
+ * rez::TaskGraph graph;
+ * graph.Add("cmake_init", {}, cmake_init);
+ * graph.Add("build", { "cmake_init" }, build);
+ * graph.Add("install", { "build" }, install);
+ * return graph.Main(argc, argv, "install");
+ * @endcode
+ */
+class TaskGraph {
+public:
+    /**
+     * @brief Add registers a task.
+     *
+     * @param name the task name
+     * @param dependencies the names of prerequisite tasks
+     * @param run the task body, returning a POSIX-style exit status
+     */
+    void Add(const std::string &name, std::vector<std::string> dependencies, std::function<int()> run) {
+        tasks_[name] = Task{ name, std::move(dependencies), std::move(run) };
+    }
+
+    /**
+     * @brief Names lists the registered tasks.
+     *
+     * @returns task names, in lexicographic order
+     */
+    std::vector<std::string> Names() const {
+        std::vector<std::string> names;
+
+        for (const auto &[name, _] : tasks_) {
+            names.push_back(name);
+        }
+
+        return names;
+    }
+
+    /**
+     * @brief Run executes a task and its transitive dependencies, skipping any which already ran.
+     *
+     * @param name the task name
+     * @param jobs the maximum number of tasks to run concurrently
+     * @returns the first non-zero task exit status, or EXIT_SUCCESS
+     *
+     * @throws an error for unknown tasks and dependency cycles
+     */
+    int Run(const std::string &name, std::size_t jobs = DefaultJobs()) {
+        std::vector<std::string> order;
+        std::map<std::string, int> marks;
+        Visit(name, marks, order);
+
+        std::map<std::string, std::size_t> remaining;
+        std::map<std::string, std::vector<std::string>> dependents;
+
+        for (const std::string &task_name : order) {
+            std::size_t count{ 0 };
+
+            for (const std::string &dependency : tasks_.at(task_name).dependencies) {
+                if (done_.count(dependency) == 0) {
+                    count++;
+                    dependents[dependency].push_back(task_name);
+                }
+            }
+
+            remaining[task_name] = count;
+        }
+
+        std::mutex mutex;
+        int status{ EXIT_SUCCESS };
+        ThreadPool pool(std::min(jobs, order.size()));
+
+        std::function<void(const std::string &)> schedule;
+        schedule = [&](const std::string &task_name) {
+            pool.Submit([&, task_name] {
+                {
+                    const std::lock_guard<std::mutex> lock(mutex);
+
+                    if (status != EXIT_SUCCESS) {
+                        return;
+                    }
+                }
+
+                int task_status{ EXIT_FAILURE };
+                const int token{ jobserver_.Acquire() };
+                History &history = History::Instance();
+                const std::int64_t start{ Trace::Now() };
+                const std::int64_t cpu_start{ history.Enabled() ? ProcessCpuTime() : 0 };
+
+                try {
+                    const Span span(task_name);
+                    task_status = tasks_.at(task_name).run();
+                } catch (const std::exception &err) {
+                    std::cerr << "error in task " << task_name << ": " << err.what() << "\n";
+                }
+
+                if (history.Enabled()) {
+                    history.Append(HistoryRecord{ task_name, start, Trace::Now() - start, ProcessCpuTime() - cpu_start, task_status });
+                }
+
+                jobserver_.Release(token);
+
+                const std::lock_guard<std::mutex> lock(mutex);
+
+                if (task_status != EXIT_SUCCESS) {
+                    if (status == EXIT_SUCCESS) {
+                        status = task_status;
+                    }
+
+                    return;
+                }
+
+                done_.insert(task_name);
+
+                for (const std::string &dependent : dependents[task_name]) {
+                    if (--remaining[dependent] == 0) {
+                        schedule(dependent);
+                    }
+                }
+            });
+        };
+
+        for (const std::string &task_name : order) {
+            if (remaining[task_name] == 0) {
+                schedule(task_name);
+            }
+        }
+
+        pool.Wait();
+        return status;
+    }
+
+    /**
+     * @brief Main implements a conventional task definition entrypoint.
+     *
+     * * No arguments runs the default task.
+     * * -l lists the available tasks.
+     * * Otherwise, each named task runs in turn, sharing run-once memoization.
+     *
+     * When rez replaced itself with this delegate, the whole run is recorded in the run history on return.
+     *
+     * @param argc argument count
+     * @param argv CLI arguments
+     * @param default_task the task to run when no task names are supplied
+     * @returns CLI exit code
+     */
+    int Main(int argc, const char **argv, const std::string &default_task) {
+        std::vector<std::string> args{ argv + 1, argv + argc };
+
+        if (!args.empty() && args.front() == "-l") {
+            for (const std::string &name : Names()) {
+                std::cout << name << "\n";
+            }
+
+            return EXIT_SUCCESS;
+        }
+
+        const int status{ RunAll(args.empty() ? std::vector<std::string>{ default_task } : args) };
+        History::Instance().AppendRun(args, status);
+        return status;
+    }
+
+private:
+    int RunAll(const std::vector<std::string> &names) {
+        for (const std::string &name : names) {
+            if (tasks_.count(name) == 0) {
+                std::cerr << "no such task: " << name << "\n";
+                return EXIT_FAILURE;
+            }
+        }
+
+        try {
+            for (const std::string &name : names) {
+                if (Run(name) != EXIT_SUCCESS) {
+                    return EXIT_FAILURE;
+                }
+            }
+        } catch (const std::exception &err) {
+            std::cerr << err.what() << "\n";
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    void Visit(const std::string &name, std::map<std::string, int> &marks, std::vector<std::string> &order) const {
+        if (done_.count(name) != 0 || marks[name] == 2) {
+            return;
+        }
+
+        if (marks[name] == 1) {
+            throw std::runtime_error("error: task dependency cycle at: " + name);
+        }
+
+        const auto it{ tasks_.find(name) };
+
+        if (it == tasks_.end()) {
+            throw std::runtime_error("error: no such task: " + name);
+        }
+
+        marks[name] = 1;
+
+        for (const std::string &dependency : it->second.dependencies) {
+            Visit(dependency, marks, order);
+        }
+
+        marks[name] = 2;
+        order.push_back(name);
+    }
+
+    std::map<std::string, Task> tasks_{};
+    std::set<std::string> done_{};
+    JobserverClient jobserver_{};
+};
+
+/**
+ * @brief QuoteWindowsArgument escapes an argument per the MSVC runtime command line parsing rules.
+ *
+ * Windows process APIs accept a single command line string, so arguments with embedded spaces would otherwise re-split.
+ *
+ * @param arg an argument
+ * @returns a quoted argument
+ */
+inline std::string QuoteWindowsArgument(const std::string &arg) {
+    if (!arg.empty() && arg.find_first_of(" \t\"") == std::string::npos) {
+        return arg;
+    }
+
+    std::string quoted{ "\"" };
+    std::size_t backslashes{ 0 };
+
+    for (const char c : arg) {
+        if (c == '\\') {
+            backslashes++;
+            continue;
+        }
+
+        if (c == '"') {
+            quoted.append(backslashes * 2 + 1, '\\');
+        } else {
+            quoted.append(backslashes, '\\');
+        }
+
+        backslashes = 0;
+        quoted += c;
+    }
+
+    quoted.append(backslashes * 2, '\\');
+    quoted += '"';
+    return quoted;
+}
+
+/**
+ * @brief RunOptions customizes @ref Run.
+ */
+struct RunOptions {
+    /**
+     * @brief capture_stdout collects the child's standard output into @ref Process::Stdout, rather than inheriting the parent's. (Default: false)
+     */
+    bool capture_stdout{ false };
+
+    /**
+     * @brief capture_stderr collects the child's standard error into @ref Process::Stderr, rather than inheriting the parent's. (Default: false)
+     */
+    bool capture_stderr{ false };
+};
+
+class Process;
+
+/**
+ * @brief WaitAll waits on several processes at once, draining any captured output concurrently.
+ *
+ * On Linux, child exits are observed via pidfd alongside the output pipes, in a single poll set.
+ *
+ * @param processes the processes to await
+ *
+ * @throws an error in the event of a problem
+ */
+void WaitAll(const std::vector<Process *> &processes);
+
+/**
+ * @brief Process is a handle to a running child process, launched directly without an intermediate shell.
+ *
+ * Example:
+ *
+ * @code
+ * rez::Process configure{ rez::Run({ "cmake", "-B", "build", "." }) };
+ * rez::Process version{ rez::Run({ "git", "describe" }, { true, false }) };
+ * rez::WaitAll({ &configure, &version });
+ * std::cout << version.Stdout();
+ * @endcode
+ */
+class Process {
+public:
+    /**
+     * @brief Process launches a child process.
+     *
+     * @param argv the program name or path, followed by its arguments
+     * @param options settings
+     *
+     * @throws an error when the process cannot be launched
+     */
+    explicit Process(const std::vector<std::string> &argv, const RunOptions &options = RunOptions{}) : name_(argv.empty() ? "" : argv.front()) {
+        if (argv.empty()) {
+            throw std::runtime_error("error spawning process: empty argv");
+        }
+
+#if defined(_WIN32)
+        if (options.capture_stdout || options.capture_stderr) {
+            throw std::runtime_error("error spawning process: output capture is unsupported on Windows: " + name_);
+        }
+
+        std::vector<std::string> quoted;
+        std::vector<const char *> c_argv;
+
+        for (const std::string &arg : argv) {
+            quoted.push_back(QuoteWindowsArgument(arg));
+        }
+
+        for (const std::string &arg : quoted) {
+            c_argv.push_back(arg.c_str());
+        }
+
+        c_argv.push_back(nullptr);
+
+        errno = 0;
+        handle_ = _spawnvp(_P_NOWAIT, name_.c_str(), c_argv.data());
+
+        if (handle_ == -1) {
+            throw std::runtime_error("error spawning process: " + name_ + " errno: " + std::to_string(errno));
+        }
+#else
+        std::vector<char *> c_argv;
+
+        for (const std::string &arg : argv) {
+            c_argv.push_back(const_cast<char *>(arg.c_str()));
+        }
+
+        c_argv.push_back(nullptr);
+
+        int out_pipe[2]{ -1, -1 };
+        int err_pipe[2]{ -1, -1 };
+
+        if ((options.capture_stdout && OpenPipe(out_pipe) != 0) || (options.capture_stderr && OpenPipe(err_pipe) != 0)) {
+            const int err{ errno };
+            ClosePipe(out_pipe);
+            ClosePipe(err_pipe);
+            throw std::runtime_error("error creating pipe for process: " + name_ + " errno: " + std::to_string(err));
+        }
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+
+        if (options.capture_stdout) {
+            posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+        }
+
+        if (options.capture_stderr) {
+            posix_spawn_file_actions_adddup2(&actions, err_pipe[1], STDERR_FILENO);
+        }
+
+        const int spawn_status{ posix_spawnp(&pid_, name_.c_str(), &actions, nullptr, c_argv.data(), environ) };
+        posix_spawn_file_actions_destroy(&actions);
+
+        if (out_pipe[1] != -1) {
+            close(out_pipe[1]);
+        }
+
+        if (err_pipe[1] != -1) {
+            close(err_pipe[1]);
+        }
+
+        out_fd_ = out_pipe[0];
+        err_fd_ = err_pipe[0];
+
+        if (spawn_status != 0) {
+            CloseOutputs();
+            throw std::runtime_error("error spawning process: " + name_ + " errno: " + std::to_string(spawn_status));
+        }
+
+#if defined(__linux__) && defined(SYS_pidfd_open)
+        // Unavailable before Linux 5.3; WaitAll then falls back to waitpid once output drains.
+        pidfd_ = static_cast<int>(syscall(SYS_pidfd_open, pid_, 0));
+#endif
+#endif
+    }
+
+    Process(const Process &) = delete;
+    Process &operator=(const Process &) = delete;
+
+    /**
+     * @brief Process transfers ownership of a child process.
+     *
+     * @param other a process handle
+     */
+    Process(Process &&other) noexcept : name_(std::move(other.name_)),
+                                        stdout_(std::move(other.stdout_)),
+                                        stderr_(std::move(other.stderr_)),
+                                        status_(other.status_),
+#if defined(_WIN32)
+                                        handle_(std::exchange(other.handle_, -1))
+#else
+                                        pid_(std::exchange(other.pid_, -1)),
+                                        pidfd_(std::exchange(other.pidfd_, -1)),
+                                        out_fd_(std::exchange(other.out_fd_, -1)),
+                                        err_fd_(std::exchange(other.err_fd_, -1))
+#endif
+    {
+    }
+
+    Process &operator=(Process &&) = delete;
+
+    /**
+     * @brief ~Process reaps the child, waiting if necessary, so that no zombie processes linger.
+     */
+    ~Process() {
+        if (Moved()) {
+            return;
+        }
+
+        try {
+            Wait();
+        } catch (const std::exception &) {
+            // Destructors must not throw.
+        }
+    }
+
+    /**
+     * @brief Wait blocks until the child exits, draining any captured output.
+     *
+     * @returns the exit status, or 128 plus the signal number for processes terminated by a signal
+     *
+     * @throws an error in the event of a problem
+     */
+    int Wait() {
+        if (Moved()) {
+            throw std::runtime_error("error waiting on moved process: " + name_);
+        }
+
+        if (!status_.has_value()) {
+            WaitAll({ this });
+        }
+
+        if (!status_.has_value()) {
+            throw std::runtime_error("error waiting on process: " + name_);
+        }
+
+        return *status_;
+    }
+
+    /**
+     * @brief Done queries whether the child has been reaped.
+     *
+     * @returns true after a successful @ref Wait or @ref WaitAll
+     */
+    bool Done() const {
+        return status_.has_value();
+    }
+
+    /**
+     * @brief Stdout accesses captured standard output.
+     *
+     * @returns the output collected so far
+     */
+    const std::string &Stdout() const {
+        return stdout_;
+    }
+
+    /**
+     * @brief Stderr accesses captured standard error.
+     *
+     * @returns the output collected so far
+     */
+    const std::string &Stderr() const {
+        return stderr_;
+    }
+
+private:
+    friend void WaitAll(const std::vector<Process *> &processes);
+
+    /**
+     * @brief Moved queries whether ownership of the child has been transferred away.
+     *
+     * @returns true for a moved-from handle
+     */
+    bool Moved() const {
+#if defined(_WIN32)
+        return handle_ == -1 && !status_.has_value();
+#else
+        return pid_ == -1 && !status_.has_value();
+#endif
+    }
+
+#if !defined(_WIN32)
+    static int OpenPipe(int (&fds)[2]) {
+        // Keep both ends out of children which other threads spawn concurrently. posix_spawn's dup2 clears FD_CLOEXEC on the child's copy.
+#if defined(__APPLE__)
+        // macOS lacks pipe2. Narrow the window, at least.
+        if (pipe(fds) != 0) {
+            return -1;
+        }
+
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        return 0;
+#else
+        return pipe2(fds, O_CLOEXEC);
+#endif
+    }
+
+    static void ClosePipe(int (&fds)[2]) {
+        for (int &fd : fds) {
+            if (fd != -1) {
+                close(fd);
+                fd = -1;
+            }
+        }
+    }
+
+    void CloseOutputs() {
+        for (int *fd : { &out_fd_, &err_fd_, &pidfd_ }) {
+            if (*fd != -1) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+    }
+
+    void Reap(int options) {
+        if (status_.has_value() || pid_ == -1) {
+            return;
+        }
+
+        int status{ 0 };
+        pid_t result{ 0 };
+
+        do {
+            result = waitpid(pid_, &status, options);
+        } while (result == -1 && errno == EINTR);
+
+        if (result == -1) {
+            throw std::runtime_error("error waiting on process: " + name_ + " errno: " + std::to_string(errno));
+        }
+
+        if (result == 0) {
+            return;
+        }
+
+        status_ = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+
+        if (pidfd_ != -1) {
+            close(pidfd_);
+            pidfd_ = -1;
+        }
+    }
+#endif
+
+    std::string name_{};
+    std::string stdout_{};
+    std::string stderr_{};
+    std::optional<int> status_{};
+#if defined(_WIN32)
+    intptr_t handle_{ -1 };
+#else
+    pid_t pid_{ -1 };
+    int pidfd_{ -1 };
+    int out_fd_{ -1 };
+    int err_fd_{ -1 };
+#endif
+};
+
+inline void WaitAll(const std::vector<Process *> &processes) {
+#if defined(_WIN32)
+    for (Process *process : processes) {
+        if (process->status_.has_value() || process->handle_ == -1) {
+            continue;
+        }
+
+        int status{ 0 };
+
+        if (_cwait(&status, process->handle_, _WAIT_CHILD) == -1) {
+            throw std::runtime_error("error waiting on process: " + process->name_ + " errno: " + std::to_string(errno));
+        }
+
+        process->status_ = status;
+    }
+#else
+    std::vector<char> buf(64 * 1024);
+
+    for (;;) {
+        std::vector<pollfd> fds;
+        std::vector<std::pair<Process *, int *>> sources;
+
+        for (Process *process : processes) {
+            for (int *fd : { &process->out_fd_, &process->err_fd_ }) {
+                if (*fd != -1) {
+                    fds.push_back(pollfd{ *fd, POLLIN, 0 });
+                    sources.emplace_back(process, fd);
+                }
+            }
+
+            // Exit notifications are only useful while output is also pending; otherwise waitpid blocks below.
+            if (process->pidfd_ != -1 && !process->status_.has_value()) {
+                fds.push_back(pollfd{ process->pidfd_, POLLIN, 0 });
+                sources.emplace_back(process, nullptr);
+            }
+        }
+
+        const bool output_pending{ std::any_of(sources.begin(), sources.end(), [](const auto &source) { return source.second != nullptr; }) };
+
+        if (!output_pending) {
+            break;
+        }
+
+        if (poll(fds.data(), static_cast<nfds_t>(fds.size()), -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            throw std::runtime_error("error polling processes errno: " + std::to_string(errno));
+        }
+
+        for (std::size_t i{ 0 }; i < fds.size(); i++) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+
+            auto &[process, fd] = sources[i];
+
+            if (fd == nullptr) {
+                process->Reap(WNOHANG);
+                continue;
+            }
+
+            const ssize_t n{ read(*fd, buf.data(), buf.size()) };
+
+            if (n > 0) {
+                (fd == &process->out_fd_ ? process->stdout_ : process->stderr_).append(buf.data(), static_cast<std::size_t>(n));
+            } else if (n == 0 || errno != EINTR) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+    }
+
+    for (Process *process : processes) {
+        process->Reap(0);
+        process->CloseOutputs();
+    }
+#endif
+}
+
+/**
+ * @brief Run launches a child process, without an intermediate shell.
+ *
+ * Unlike std::system, Run returns immediately, so several commands may run at once.
+ *
+ * @param argv the program name or path, followed by its arguments
+ * @param options settings
+ * @returns a handle to the running process
+ *
+ * @throws an error when the process cannot be launched
+ */
+inline Process Run(const std::vector<std::string> &argv, const RunOptions &options = RunOptions{}) {
+    return Process(argv, options);
+}
+
+/**
+ * @brief GlobMatch matches a path against a glob pattern.
+ *
+ * * * matches any run of characters within a path segment.
+ * * ? matches any single character within a path segment.
+ * * ** matches any number of whole path segments.
+ *
+ * Both arguments use forward slashes, as in std::filesystem::path::generic_string.
+ *
+ * @param pattern a glob pattern
+ * @param path a relative path
+ * @returns true when the path matches
+ */
+inline bool GlobMatch(std::string_view pattern, std::string_view path) {
+    if (pattern.empty()) {
+        return path.empty();
+    }
+
+    if (pattern.substr(0, 2) == "**") {
+        std::string_view rest{ pattern.substr(2) };
+
+        if (!rest.empty() && rest.front() == '/') {
+            rest.remove_prefix(1);
+        }
+
+        if (rest.empty()) {
+            return true;
+        }
+
+        for (std::size_t i{ 0 }; i <= path.size(); i++) {
+            if ((i == 0 || path[i - 1] == '/') && GlobMatch(rest, path.substr(i))) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    if (pattern.front() == '*') {
+        for (std::size_t i{ 0 }; i <= path.size(); i++) {
+            if (GlobMatch(pattern.substr(1), path.substr(i))) {
+                return true;
+            }
+
+            if (i < path.size() && path[i] == '/') {
+                break;
+            }
+        }
+
+        return false;
+    }
+
+    if (path.empty()) {
+        return false;
+    }
+
+    if (pattern.front() == '?' ? path.front() != '/' : pattern.front() == path.front()) {
+        return GlobMatch(pattern.substr(1), path.substr(1));
+    }
+
+    return false;
+}
+
+/**
+ * @brief ExpandGlob lists the files matching a glob pattern, per @ref GlobMatch.
+ *
+ * Patterns without wildcards name a single path, which is returned whether or not it exists, so that missing inputs are noticed.
+ *
+ * @param pattern a glob pattern, relative to the current working directory
+ * @returns matching file paths, in lexicographic order
+ */
+inline std::vector<std::filesystem::path> ExpandGlob(const std::string &pattern) {
+    if (pattern.find_first_of("*?") == std::string::npos) {
+        return { std::filesystem::path(pattern) };
+    }
+
+    // Walk from the deepest directory without wildcards.
+    const std::size_t wildcard{ pattern.find_first_of("*?") };
+    const std::size_t slash{ pattern.rfind('/', wildcard) };
+    const std::filesystem::path root{ slash == std::string::npos ? "." : pattern.substr(0, slash) };
+    const std::string relative_pattern{ slash == std::string::npos ? pattern : pattern.substr(slash + 1) };
+
+    std::vector<std::filesystem::path> matches;
+    std::error_code ec;
+
+    for (auto it{ std::filesystem::recursive_directory_iterator(root, std::filesystem::directory_options::skip_permission_denied, ec) };
+         it != std::filesystem::recursive_directory_iterator();
+         it.increment(ec)) {
+        if (ec) {
+            break;
+        }
+
+        if (!it->is_regular_file(ec)) {
+            continue;
+        }
+
+        const std::string relative{ it->path().lexically_relative(root).generic_string() };
+
+        if (GlobMatch(relative_pattern, relative)) {
+            matches.push_back(slash == std::string::npos ? std::filesystem::path(relative) : it->path());
+        }
+    }
+
+    std::sort(matches.begin(), matches.end());
+    return matches;
+}
+
+/**
+ * @brief DirectoryEntry denotes a child of a directory, as listed by @ref ReadDirectory.
+ */
+struct DirectoryEntry {
+    /**
+     * @brief name denotes the basename.
+     */
+    std::string name{};
+
+    /**
+     * @brief type denotes the entry type, without following symlinks.
+     */
+    std::filesystem::file_type type{ std::filesystem::file_type::unknown };
+};
+
+/**
+ * @brief ReadDirectory lists the children of a directory, excluding . and ..
+ *
+ * On Linux, entries are read in bulk with getdents64, whose records carry the entry type, so that walks rarely stat individual entries.
+ *
+ * @param path a directory
+ * @returns entries, in no particular order
+ *
+ * @throws an error in the event of a problem
+ */
+inline std::vector<DirectoryEntry> ReadDirectory(const std::filesystem::path &path) {
+    std::vector<DirectoryEntry> entries;
+
+#if defined(_WIN32)
+    for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(path)) {
+        entries.push_back(DirectoryEntry{ entry.path().filename().string(), entry.symlink_status().type() });
+    }
+#else
+    const auto append{ [&entries, &path](const char *name, unsigned char d_type) {
+        if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) {
+            return;
+        }
+
+        std::filesystem::file_type type{ std::filesystem::file_type::unknown };
+
+        switch (d_type) {
+        case DT_REG:
+            type = std::filesystem::file_type::regular;
+            break;
+        case DT_DIR:
+            type = std::filesystem::file_type::directory;
+            break;
+        case DT_LNK:
+            type = std::filesystem::file_type::symlink;
+            break;
+        default:
+            // Some filesystems leave the type unreported.
+            type = std::filesystem::symlink_status(path / name).type();
+        }
+
+        entries.push_back(DirectoryEntry{ name, type });
+    } };
+
+#if defined(__linux__)
+    const int fd{ open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC) };
+
+    if (fd == -1) {
+        throw std::runtime_error("error: unable to open directory: " + path.string());
+    }
+
+    alignas(8) char records[32768];
+
+    for (;;) {
+        const long n{ syscall(SYS_getdents64, fd, records, sizeof(records)) };
+
+        if (n == -1) {
+            close(fd);
+            throw std::runtime_error("error: unable to read directory: " + path.string());
+        }
+
+        if (n == 0) {
+            break;
+        }
+
+        // struct linux_dirent64 { ino64_t d_ino; off64_t d_off; unsigned short d_reclen; unsigned char d_type; char d_name[]; }
+        for (long offset{ 0 }; offset < n;) {
+            const char *record{ records + offset };
+            unsigned short record_length{ 0 };
+            std::memcpy(&record_length, record + 16, sizeof(record_length));
+            append(record + 19, static_cast<unsigned char>(record[18]));
+            offset += record_length;
+        }
+    }
+
+    close(fd);
+#else
+    DIR *dir{ opendir(path.c_str()) };
+
+    if (dir == nullptr) {
+        throw std::runtime_error("error: unable to open directory: " + path.string());
+    }
+
+    while (const struct dirent *entry = readdir(dir)) {
+        append(entry->d_name, entry->d_type);
+    }
+
+    closedir(dir);
+#endif
+#endif
+
+    return entries;
+}
+
+/**
+ * @brief VisitTree calls a function for every entry beneath a directory, listing subdirectories in parallel on a @ref ThreadPool of @ref DefaultJobs workers.
+ *
+ * Symlinks are not followed. A directory is always visited before its children.
+ *
+ * @param root a directory
+ * @param visit called concurrently with each entry path and type; for directories, returns true to descend
+ *
+ * @throws an error in the event of a problem, including errors thrown by visit
+ */
+inline void VisitTree(const std::filesystem::path &root, const std::function<bool(const std::filesystem::path &, std::filesystem::file_type)> &visit) {
+    std::mutex mutex;
+    std::exception_ptr error{ nullptr };
+    std::atomic<bool> failed{ false };
+    std::function<void(const std::filesystem::path &)> list;
+    ThreadPool pool(DefaultJobs());
+
+    list = [&](const std::filesystem::path &directory) {
+        if (failed) {
+            return;
+        }
+
+        try {
+            for (const DirectoryEntry &entry : ReadDirectory(directory)) {
+                std::filesystem::path path{ directory / entry.name };
+
+                if (visit(path, entry.type) && entry.type == std::filesystem::file_type::directory) {
+                    pool.Submit([&list, path = std::move(path)] { list(path); });
+                }
+            }
+        } catch (...) {
+            const std::lock_guard<std::mutex> lock(mutex);
+
+            if (!error) {
+                error = std::current_exception();
+            }
+
+            failed = true;
+        }
+    };
+
+    pool.Submit([&list, &root] { list(root); });
+    pool.Wait();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+/**
+ * @brief CloneFile copies a regular file, replacing any destination file, and preserving permissions and modification time.
+ *
+ * On Linux, the copy first attempts a reflink (FICLONE), which shares extents on copy-on-write filesystems such as btrfs and XFS. Otherwise, copy_file_range copies within the kernel, falling back to read/write across filesystems which do not support it.
+ *
+ * @param source a regular file
+ * @param destination a file path
+ *
+ * @throws an error in the event of a problem
+ */
+inline void CloneFile(const std::filesystem::path &source, const std::filesystem::path &destination) {
+#if defined(__linux__)
+    const int in{ open(source.c_str(), O_RDONLY | O_CLOEXEC) };
+
+    if (in == -1) {
+        throw std::runtime_error("error: unable to open file: " + source.string());
+    }
+
+    struct stat st {};
+
+    if (fstat(in, &st) == -1) {
+        close(in);
+        throw std::runtime_error("error: unable to query file: " + source.string());
+    }
+
+    // Unlink first, so that hard links to the old destination, such as running executables, are unaffected.
+    unlink(destination.c_str());
+    const int out{ open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 07777) };
+
+    if (out == -1) {
+        close(in);
+        throw std::runtime_error("error: unable to create file: " + destination.string());
+    }
+
+    // Spare every task definition linux/fs.h, which conflicts with sys/mount.h.
+#if !defined(FICLONE)
+    constexpr unsigned long FICLONE{ _IOW(0x94, 9, int) };
+#endif
+    bool ok{ syscall(SYS_ioctl, out, FICLONE, in) == 0 };
+
+    if (!ok) {
+        ok = true;
+
+        for (;;) {
+            const ssize_t n{ copy_file_range(in, nullptr, out, nullptr, 1 << 30, 0) };
+
+            if (n == 0) {
+                break;
+            }
+
+            if (n > 0) {
+                continue;
+            }
+
+            // File offsets have advanced past any bytes copied so far.
+            char buf[65536];
+            ssize_t r{ 0 };
+
+            while ((r = read(in, buf, sizeof(buf))) > 0) {
+                for (ssize_t w{ 0 }; w < r;) {
+                    const ssize_t k{ write(out, buf + w, static_cast<std::size_t>(r - w)) };
+
+                    if (k == -1) {
+                        r = -1;
+                        break;
+                    }
+
+                    w += k;
+                }
+
+                if (r == -1) {
+                    break;
+                }
+            }
+
+            ok = r == 0;
+            break;
+        }
+    }
+
+    const struct timespec times[2]{ st.st_atim, st.st_mtim };
+    ok = ok && futimens(out, times) == 0;
+    ok = close(out) == 0 && ok;
+    close(in);
+
+    if (!ok) {
+        throw std::runtime_error("error: unable to copy file: " + source.string() + " to " + destination.string());
+    }
+#else
+    std::filesystem::copy_file(source, destination, std::filesystem::copy_options::overwrite_existing);
+    std::filesystem::last_write_time(destination, std::filesystem::last_write_time(source));
+#endif
+}
+
+/**
+ * @brief RemoveTree removes a file or directory tree, like std::filesystem::remove_all, deleting files across subdirectories in parallel per @ref VisitTree.
+ *
+ * @param path a path, which need not exist
+ * @returns the number of files and directories removed
+ *
+ * @throws an error in the event of a problem
+ */
+inline std::uintmax_t RemoveTree(const std::filesystem::path &path) {
+    std::error_code ec;
+    const std::filesystem::file_status status{ std::filesystem::symlink_status(path, ec) };
+
+    if (!std::filesystem::exists(status)) {
+        return 0;
+    }
+
+    if (!std::filesystem::is_directory(status)) {
+        std::filesystem::remove(path);
+        return 1;
+    }
+
+    std::mutex mutex;
+    std::vector<std::filesystem::path> directories{ path };
+    std::atomic<std::uintmax_t> removed{ 0 };
+
+    VisitTree(path, [&mutex, &directories, &removed](const std::filesystem::path &entry, std::filesystem::file_type type) {
+        if (type == std::filesystem::file_type::directory) {
+            const std::lock_guard<std::mutex> lock(mutex);
+            directories.push_back(entry);
+            return true;
+        }
+
+        std::filesystem::remove(entry);
+        removed++;
+        return false;
+    });
+
+    // Each directory was recorded before its children, so reverse order empties children first.
+    for (auto it{ directories.rbegin() }; it != directories.rend(); it++) {
+        std::filesystem::remove(*it);
+    }
+
+    return removed + directories.size();
+}
+
+/**
+ * @brief MirrorTree implements @ref CopyTree and @ref SyncTree.
+ *
+ * @param source a file or directory
+ * @param destination a path
+ * @param sync whether to skip unchanged files and remove stale destination entries
+ * @returns the number of files copied
+ *
+ * @throws an error in the event of a problem
+ */
+inline std::uintmax_t MirrorTree(const std::filesystem::path &source, const std::filesystem::path &destination, bool sync) {
+    const auto unchanged{ [sync](const std::filesystem::path &from, const std::filesystem::path &to) {
+        std::error_code ec;
+
+        if (!sync || !std::filesystem::is_regular_file(std::filesystem::symlink_status(to, ec))) {
+            return false;
+        }
+
+        return std::filesystem::file_size(from) == std::filesystem::file_size(to, ec) && std::filesystem::last_write_time(from) == std::filesystem::last_write_time(to, ec);
+    } };
+
+    const auto replace{ [](const std::filesystem::path &to, std::filesystem::file_type type) {
+        std::error_code ec;
+        const std::filesystem::file_type existing{ std::filesystem::symlink_status(to, ec).type() };
+
+        if (existing != std::filesystem::file_type::not_found && existing != type) {
+            RemoveTree(to);
+        }
+    } };
+
+    const auto copy{ [&unchanged, &replace](const std::filesystem::path &from, const std::filesystem::path &to, std::filesystem::file_type type) -> std::uintmax_t {
+        switch (type) {
+        case std::filesystem::file_type::directory:
+            replace(to, type);
+            std::filesystem::create_directory(to);
+            return 0;
+        case std::filesystem::file_type::regular:
+            if (unchanged(from, to)) {
+                return 0;
+            }
+
+            replace(to, type);
+            CloneFile(from, to);
+            return 1;
+        case std::filesystem::file_type::symlink: {
+            const std::filesystem::path target{ std::filesystem::read_symlink(from) };
+            std::error_code ec;
+
+            if (std::filesystem::is_symlink(std::filesystem::symlink_status(to, ec)) && std::filesystem::read_symlink(to, ec) == target) {
+                return 0;
+            }
+
+            RemoveTree(to);
+            std::filesystem::create_symlink(target, to);
+            return 1;
+        }
+        default:
+            // Sockets, fifos, and devices are not copied.
+            return 0;
+        }
+    } };
+
+    const std::filesystem::file_type source_type{ std::filesystem::symlink_status(source).type() };
+
+    if (source_type == std::filesystem::file_type::not_found) {
+        throw std::runtime_error("error: no such file or directory: " + source.string());
+    }
+
+    std::atomic<std::uintmax_t> copied{ copy(source, destination, source_type) };
+
+    if (source_type != std::filesystem::file_type::directory) {
+        return copied;
+    }
+
+    VisitTree(source, [&source, &destination, &copy, &copied](const std::filesystem::path &entry, std::filesystem::file_type type) {
+        copied += copy(entry, destination / entry.lexically_relative(source), type);
+        return true;
+    });
+
+    if (sync) {
+        std::mutex mutex;
+        std::vector<std::filesystem::path> stale;
+
+        VisitTree(destination, [&source, &destination, &mutex, &stale](const std::filesystem::path &entry, std::filesystem::file_type) {
+            std::error_code ec;
+
+            if (std::filesystem::exists(std::filesystem::symlink_status(source / entry.lexically_relative(destination), ec))) {
+                return true;
+            }
+
+            const std::lock_guard<std::mutex> lock(mutex);
+            stale.push_back(entry);
+            return false;
+        });
+
+        for (const std::filesystem::path &entry : stale) {
+            RemoveTree(entry);
+        }
+    }
+
+    return copied;
+}
+
+/**
+ * @brief CopyTree copies a file or directory tree, like std::filesystem::copy with recursive and overwrite_existing options, copying files across subdirectories in parallel per @ref VisitTree.
+ *
+ * Files are copied per @ref CloneFile. Symlinks are copied as symlinks.
+ *
+ * @param source a file or directory
+ * @param destination a path, whose parent directory exists
+ * @returns the number of files copied
+ *
+ * @throws an error in the event of a problem
+ */
+inline std::uintmax_t CopyTree(const std::filesystem::path &source, const std::filesystem::path &destination) {
+    return MirrorTree(source, destination, false);
+}
+
+/**
+ * @brief SyncTree makes a destination tree mirror a source tree, like rsync -a --delete, in parallel per @ref VisitTree.
+ *
+ * Files whose size and modification time already match are skipped. Destination entries absent from the source are removed.
+ *
+ * @param source a file or directory
+ * @param destination a path, whose parent directory exists
+ * @returns the number of files copied
+ *
+ * @throws an error in the event of a problem
+ */
+inline std::uintmax_t SyncTree(const std::filesystem::path &source, const std::filesystem::path &destination) {
+    return MirrorTree(source, destination, true);
+}
+
+/**
+ * @brief IgnoreRule denotes a .gitignore pattern, rewritten relative to a walk root.
+ */
+struct IgnoreRule {
+    /**
+     * @brief pattern denotes a @ref GlobMatch pattern, relative to the walk root.
+     */
+    std::string pattern{};
+
+    /**
+     * @brief negate denotes a ! rule, which re-includes matching paths.
+     */
+    bool negate{ false };
+
+    /**
+     * @brief directory_only denotes a rule with a trailing slash, which only matches directories.
+     */
+    bool directory_only{ false };
+};
+
+/**
+ * @brief ParseIgnoreFile reads the rules of a .gitignore file.
+ *
+ * Patterns without a slash match at any depth beneath base. Character classes such as [abc] are not supported.
+ *
+ * @param path an ignore file, which need not exist
+ * @param base the directory containing the ignore file, relative to the walk root, in generic format (empty for the root)
+ * @param rules the rule list to extend
+ */
+inline void ParseIgnoreFile(const std::filesystem::path &path, const std::string &base, std::vector<IgnoreRule> &rules) {
+    std::ifstream f(path);
+    std::string line;
+
+    while (getline(f, line)) {
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+            line.pop_back();
+        }
+
+        if (line.empty() || line.front() == '#') {
+            continue;
+        }
+
+        IgnoreRule rule;
+
+        if (line.front() == '!') {
+            rule.negate = true;
+            line.erase(0, 1);
+        } else if (line.front() == '\\') {
+            line.erase(0, 1);
+        }
+
+        if (!line.empty() && line.back() == '/') {
+            rule.directory_only = true;
+            line.pop_back();
+        }
+
+        if (line.empty()) {
+            continue;
+        }
+
+        if (line.find('/') == std::string::npos) {
+            line = "**/" + line;
+        } else if (line.front() == '/') {
+            line.erase(0, 1);
+        }
+
+        rule.pattern = base.empty() ? line : base + "/" + line;
+        rules.push_back(std::move(rule));
+    }
+}
+
+/**
+ * @brief Ignored applies ignore rules to a path, the last matching rule winning.
+ *
+ * @param rules ignore rules
+ * @param relative a path relative to the walk root, in generic format
+ * @param directory whether the path denotes a directory
+ * @returns true when the path is ignored
+ */
+inline bool Ignored(const std::vector<IgnoreRule> &rules, std::string_view relative, bool directory) {
+    bool ignored{ false };
+
+    for (const IgnoreRule &rule : rules) {
+        // Skip rules which cannot change the outcome.
+        if (ignored == !rule.negate || (rule.directory_only && !directory)) {
+            continue;
+        }
+
+        if (GlobMatch(rule.pattern, relative)) {
+            ignored = !rule.negate;
+        }
+    }
+
+    return ignored;
+}
+
+/**
+ * @brief Glob streams the files beneath a directory matching any of several @ref GlobMatch patterns, honoring .gitignore files.
+ *
+ * Subdirectories are listed in parallel on a @ref ThreadPool of @ref DefaultJobs workers, per @ref ReadDirectory. Ignored directories, .git directories, and directories outside the literal directory prefix of every pattern (such as anything but src, when every pattern begins with src) are pruned without listing. Ignore files beneath root apply, as does root/.git/info/exclude.
+ *
+ * Symlinks to files match; symlinks to directories are not followed.
+ *
+ * @param patterns glob patterns, relative to root
+ * @param match called with each matching file path (prefixed with root, unless root is "."), one call at a time, in no particular order
+ * @param root a directory
+ *
+ * @throws an error in the event of a problem, including errors thrown by match
+ */
+inline void Glob(const std::vector<std::string> &patterns, const std::function<void(const std::filesystem::path &)> &match, const std::filesystem::path &root = ".") {
+    // Literal directory prefixes, before each pattern's first wildcard segment.
+    std::vector<std::string> prefixes;
+
+    for (const std::string &pattern : patterns) {
+        std::string prefix;
+        std::size_t start{ 0 };
+
+        for (std::size_t slash{ pattern.find('/') }; slash != std::string::npos; slash = pattern.find('/', start)) {
+            const std::string segment{ pattern.substr(start, slash - start) };
+
+            if (segment.find_first_of("*?") != std::string::npos) {
+                break;
+            }
+
+            prefix += segment + "/";
+            start = slash + 1;
+        }
+
+        prefixes.push_back(prefix);
+    }
+
+    const auto reachable{ [&prefixes](const std::string &relative) {
+        const std::string directory{ relative + "/" };
+
+        for (const std::string &prefix : prefixes) {
+            const std::size_t n{ std::min(prefix.size(), directory.size()) };
+
+            if (prefix.compare(0, n, directory, 0, n) == 0) {
+                return true;
+            }
+        }
+
+        return false;
+    } };
+
+    std::mutex mutex;
+    std::exception_ptr error{ nullptr };
+    std::atomic<bool> failed{ false };
+    std::function<void(const std::string &, std::shared_ptr<const std::vector<IgnoreRule>>)> list;
+    ThreadPool pool(DefaultJobs());
+
+    list = [&](const std::string &relative, std::shared_ptr<const std::vector<IgnoreRule>> rules) {
+        if (failed) {
+            return;
+        }
+
+        try {
+            const std::filesystem::path directory{ relative.empty() ? root : root / relative };
+            const std::vector<DirectoryEntry> entries{ ReadDirectory(directory) };
+
+            if (std::any_of(entries.begin(), entries.end(), [](const DirectoryEntry &entry) { return entry.name == ".gitignore"; })) {
+                auto extended{ std::make_shared<std::vector<IgnoreRule>>(*rules) };
+                ParseIgnoreFile(directory / ".gitignore", relative, *extended);
+                rules = std::move(extended);
+            }
+
+            for (const DirectoryEntry &entry : entries) {
+                if (entry.name == ".git") {
+                    continue;
+                }
+
+                std::string child{ relative.empty() ? entry.name : relative + "/" + entry.name };
+
+                if (entry.type == std::filesystem::file_type::directory) {
+                    if (reachable(child) && !Ignored(*rules, child, true)) {
+                        pool.Submit([&list, child = std::move(child), rules] { list(child, rules); });
+                    }
+
+                    continue;
+                }
+
+                std::error_code ec;
+
+                if (entry.type != std::filesystem::file_type::regular && !(entry.type == std::filesystem::file_type::symlink && std::filesystem::is_regular_file(directory / entry.name, ec))) {
+                    continue;
+                }
+
+                if (std::none_of(patterns.begin(), patterns.end(), [&child](const std::string &pattern) { return GlobMatch(pattern, child); }) || Ignored(*rules, child, false)) {
+                    continue;
+                }
+
+                const std::lock_guard<std::mutex> lock(mutex);
+
+                if (!failed) {
+                    match(root == "." ? std::filesystem::path(child) : root / child);
+                }
+            }
+        } catch (...) {
+            const std::lock_guard<std::mutex> lock(mutex);
+
+            if (!error) {
+                error = std::current_exception();
+            }
+
+            failed = true;
+        }
+    };
+
+    auto rules{ std::make_shared<std::vector<IgnoreRule>>() };
+    ParseIgnoreFile(root / ".git" / "info" / "exclude", "", *rules);
+    pool.Submit([&list, rules] { list("", rules); });
+    pool.Wait();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+/**
+ * @brief FileStat denotes the cheap-to-query identity of a file, plus its content digest.
+ */
+struct FileStat {
+    /**
+     * @brief size denotes the file size in bytes.
+     */
+    std::uint64_t size{ 0 };
+
+    /**
+     * @brief mtime denotes the modification time, in nanoseconds where supported.
+     */
+    std::int64_t mtime{ 0 };
+
+    /**
+     * @brief inode denotes the file serial number (zero on Windows).
+     */
+    std::uint64_t inode{ 0 };
+
+    /**
+     * @brief hash denotes the @ref HashFile digest of the file contents.
+     */
+    std::uint64_t hash{ 0 };
+};
+
+/**
+ * @brief StateDatabase persists file stats and task stamps under CacheDir.
+ *
+ * File contents are only re-hashed when a file's (size, mtime, inode) tuple changes, so checking an unchanged tree costs one stat per file.
+ *
+ * The database is a compact binary file, rewritten atomically via rename. Access @ref Instance from any thread.
+ */
+class StateDatabase {
+public:
+    /**
+     * @brief StateDatabase loads a database file, if present.
+     *
+     * @param path the database file path
+     */
+    explicit StateDatabase(std::filesystem::path path) : path_(std::move(path)) {
+        Load(path_, files_, stamps_);
+    }
+
+    /**
+     * @brief Instance accesses the database for the current working directory's CacheDir.
+     *
+     * @returns the shared database
+     */
+    static StateDatabase &Instance() {
+        static StateDatabase instance(std::filesystem::path(CacheDir) / StateDatabaseBasename);
+        return instance;
+    }
+
+    /**
+     * @brief Hash digests a file's contents, reusing the recorded digest when the file's stat tuple is unchanged.
+     *
+     * @param path a file path
+     * @returns a digest; or std::nullopt for missing files
+     */
+    std::optional<std::uint64_t> Hash(const std::filesystem::path &path) {
+        std::optional<FileStat> current{ Stat(path) };
+
+        if (!current.has_value()) {
+            return std::nullopt;
+        }
+
+        const std::string key{ path.generic_string() };
+
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            const auto it{ files_.find(key) };
+
+            if (it != files_.end() && it->second.size == current->size && it->second.mtime == current->mtime && it->second.inode == current->inode) {
+                return it->second.hash;
+            }
+        }
+
+        try {
+            current->hash = HashFile(path, 0);
+        } catch (const std::runtime_error &) {
+            return std::nullopt;
+        }
+
+        const std::lock_guard<std::mutex> lock(mutex_);
+        files_[key] = *current;
+        dirty_files_.insert(key);
+        return current->hash;
+    }
+
+    /**
+     * @brief Stamp queries the digest recorded for a key.
+     *
+     * @param key a task name
+     * @returns the recorded digest, or std::nullopt
+     */
+    std::optional<std::uint64_t> Stamp(const std::string &key) const {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        const auto it{ stamps_.find(key) };
+
+        if (it == stamps_.end()) {
+            return std::nullopt;
+        }
+
+        return it->second;
+    }
+
+    /**
+     * @brief SetStamp records a digest for a key, and saves the database.
+     *
+     * @param key a task name
+     * @param digest a digest
+     *
+     * @throws an error in the event of a problem
+     */
+    void SetStamp(const std::string &key, std::uint64_t digest) {
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            stamps_[key] = digest;
+            dirty_stamps_.insert(key);
+        }
+
+        Save();
+    }
+
+    /**
+     * @brief Save writes the database, when modified, via a temporary file and rename.
+     *
+     * Concurrent rez processes share the database file. Save merges this process's modifications into the file under the CacheDir lock, so that no process discards another's entries.
+     *
+     * @throws an error in the event of a problem
+     */
+    void Save() {
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+
+            if (dirty_files_.empty() && dirty_stamps_.empty()) {
+                return;
+            }
+        }
+
+        const FileLock file_lock(path_.parent_path() / LockFileBasename);
+        const std::lock_guard<std::mutex> lock(mutex_);
+
+        if (dirty_files_.empty() && dirty_stamps_.empty()) {
+            return;
+        }
+
+        std::map<std::string, FileStat> files;
+        std::map<std::string, std::uint64_t> stamps;
+        Load(path_, files, stamps);
+
+        for (const std::string &key : dirty_files_) {
+            files[key] = files_[key];
+        }
+
+        for (const std::string &key : dirty_stamps_) {
+            stamps[key] = stamps_[key];
+        }
+
+        files_.swap(files);
+        stamps_.swap(stamps);
+        std::filesystem::path temp_path{ path_ };
+        temp_path += ".tmp" + std::to_string(CurrentProcessId()) + "-" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+        {
+            std::ofstream f(temp_path, std::ios::binary | std::ios::trunc);
+            f.write(Magic, sizeof(Magic));
+
+            const std::uint64_t file_count{ files_.size() };
+            f.write(reinterpret_cast<const char *>(&file_count), sizeof(file_count));
+
+            for (const auto &[key, stat] : files_) {
+                WriteString(f, key);
+                f.write(reinterpret_cast<const char *>(&stat), sizeof(stat));
+            }
+
+            const std::uint64_t stamp_count{ stamps_.size() };
+            f.write(reinterpret_cast<const char *>(&stamp_count), sizeof(stamp_count));
+
+            for (const auto &[key, digest] : stamps_) {
+                WriteString(f, key);
+                f.write(reinterpret_cast<const char *>(&digest), sizeof(digest));
+            }
+
+            if (!f) {
+                throw std::runtime_error("error writing state database: " + temp_path.string());
+            }
+        }
+
+        std::filesystem::rename(temp_path, path_);
+        dirty_files_.clear();
+        dirty_stamps_.clear();
+    }
+
+    /**
+     * @brief Stat queries a file's size, modification time, and inode, without hashing.
+     *
+     * @param path a file path
+     * @returns the stat tuple (hash zero); or std::nullopt for missing files
+     */
+    static std::optional<FileStat> Stat(const std::filesystem::path &path) {
+        FileStat stat;
+#if defined(_WIN32)
+        std::error_code ec;
+        stat.size = std::filesystem::file_size(path, ec);
+
+        if (ec) {
+            return std::nullopt;
+        }
+
+        stat.mtime = static_cast<std::int64_t>(std::filesystem::last_write_time(path, ec).time_since_epoch().count());
+#else
+        struct stat st {};
+
+        if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            return std::nullopt;
+        }
+
+        stat.size = static_cast<std::uint64_t>(st.st_size);
+        stat.inode = static_cast<std::uint64_t>(st.st_ino);
+#if defined(__APPLE__)
+        stat.mtime = static_cast<std::int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+        stat.mtime = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+        return stat;
+    }
+
+private:
+    static constexpr char Magic[8]{ 'R', 'E', 'Z', 'S', 'T', 'A', 'T', '1' };
+
+    /**
+     * @brief Load reads a database file, if present and well formed.
+     *
+     * @param path the database file path
+     * @param files receives file stat tuples
+     * @param stamps receives task digests
+     */
+    static void Load(const std::filesystem::path &path, std::map<std::string, FileStat> &files, std::map<std::string, std::uint64_t> &stamps) {
+        std::ifstream f(path, std::ios::binary);
+        char magic[sizeof(Magic)]{ 0 };
+
+        if (!f.read(magic, sizeof(magic)) || memcmp(magic, Magic, sizeof(Magic)) != 0) {
+            return;
+        }
+
+        std::uint64_t file_count{ 0 };
+        f.read(reinterpret_cast<char *>(&file_count), sizeof(file_count));
+
+        for (std::uint64_t i{ 0 }; i < file_count && f; i++) {
+            const std::string key{ ReadString(f) };
+            FileStat stat;
+            f.read(reinterpret_cast<char *>(&stat), sizeof(stat));
+            files[key] = stat;
+        }
+
+        std::uint64_t stamp_count{ 0 };
+        f.read(reinterpret_cast<char *>(&stamp_count), sizeof(stamp_count));
+
+        for (std::uint64_t i{ 0 }; i < stamp_count && f; i++) {
+            const std::string key{ ReadString(f) };
+            std::uint64_t digest{ 0 };
+            f.read(reinterpret_cast<char *>(&digest), sizeof(digest));
+            stamps[key] = digest;
+        }
+
+        if (!f) {
+            files.clear();
+            stamps.clear();
+        }
+    }
+
+    static std::string ReadString(std::istream &f) {
+        std::uint32_t size{ 0 };
+        f.read(reinterpret_cast<char *>(&size), sizeof(size));
+        std::string s(f ? size : 0, '\0');
+        f.read(s.data(), static_cast<std::streamsize>(s.size()));
+        return s;
+    }
+
+    static void WriteString(std::ostream &f, const std::string &s) {
+        const auto size{ static_cast<std::uint32_t>(s.size()) };
+        f.write(reinterpret_cast<const char *>(&size), sizeof(size));
+        f.write(s.data(), static_cast<std::streamsize>(s.size()));
+    }
+
+    std::filesystem::path path_;
+    mutable std::mutex mutex_{};
+    std::map<std::string, FileStat> files_{};
+    std::map<std::string, std::uint64_t> stamps_{};
+    std::set<std::string> dirty_files_{};
+    std::set<std::string> dirty_stamps_{};
+};
+
+/**
+ * @brief DigestFiles combines the paths and contents of the files matching a set of glob patterns.
+ *
+ * @param patterns glob patterns, per @ref ExpandGlob
+ * @param seed a starting value
+ * @returns a digest, which also reflects missing files
+ */
+inline std::uint64_t DigestFiles(const std::vector<std::string> &patterns, std::uint64_t seed) {
+    StateDatabase &db = StateDatabase::Instance();
+    std::uint64_t h{ seed };
+
+    for (const std::string &pattern : patterns) {
+        h = HashBytes(pattern.data(), pattern.size() + 1, h);
+
+        for (const std::filesystem::path &path : ExpandGlob(pattern)) {
+            const std::string path_s{ path.generic_string() };
+            h = HashBytes(path_s.data(), path_s.size() + 1, h);
+
+            const std::optional<std::uint64_t> digest{ db.Hash(path) };
+            const std::uint64_t digest_value{ digest.value_or(0) };
+            h = HashBytes(reinterpret_cast<const char *>(&digest_value), sizeof(digest_value), h);
+            h = HashBytes(digest.has_value() ? "+" : "-", 1, h);
+        }
+    }
+
+    return h;
+}
+
+/**
+ * @brief UpToDate determines whether a task may be skipped.
+ *
+ * @param name a unique task name
+ * @param inputs glob patterns for the files the task reads
+ * @param outputs glob patterns for the files the task writes
+ * @returns true when every input and output matches the state recorded by @ref MarkUpToDate
+ */
+inline bool UpToDate(const std::string &name, const std::vector<std::string> &inputs, const std::vector<std::string> &outputs) {
+    const std::optional<std::uint64_t> stamp{ StateDatabase::Instance().Stamp(name) };
+
+    if (!stamp.has_value()) {
+        return false;
+    }
+
+    const bool up_to_date{ *stamp == DigestFiles(outputs, DigestFiles(inputs, 0)) };
+    StateDatabase::Instance().Save();
+    return up_to_date;
+}
+
+/**
+ * @brief MarkUpToDate records the current state of a task's inputs and outputs, after a successful run.
+ *
+ * @param name a unique task name
+ * @param inputs glob patterns for the files the task reads
+ * @param outputs glob patterns for the files the task writes
+ *
+ * @throws an error in the event of a problem
+ */
+inline void MarkUpToDate(const std::string &name, const std::vector<std::string> &inputs, const std::vector<std::string> &outputs) {
+    StateDatabase::Instance().SetStamp(name, DigestFiles(outputs, DigestFiles(inputs, 0)));
+}
+
+/**
+ * @brief Incremental wraps a task, skipping it while its inputs and outputs are unchanged since its last successful run.
+ *
+ * Example:
+ *
+ * @code
+ * tasks.Add("build", { "cmake_init" }, rez::Incremental("build", { "CMakeLists.txt", "app.cpp" }, { "build/bin/app" }, build));
+ * @endcode
+ *
+ * @param name a unique task name
+ * @param inputs glob patterns for the files the task reads
+ * @param outputs glob patterns for the files the task writes
+ * @param run the task body
+ * @returns a task body
+ */
+inline std::function<int()> Incremental(std::string name, std::vector<std::string> inputs, std::vector<std::string> outputs, std::function<int()> run) {
+    return [name = std::move(name), inputs = std::move(inputs), outputs = std::move(outputs), run = std::move(run)]() -> int {
+        if (UpToDate(name, inputs, outputs)) {
+            return EXIT_SUCCESS;
+        }
+
+        const int status{ run() };
+
+        if (status == EXIT_SUCCESS) {
+            MarkUpToDate(name, inputs, outputs);
+        }
+
+        return status;
+    };
+}
+
+/**
+ * @brief OutputKey digests a task's name, inputs, output patterns, and environment, naming its entry in the output cache.
+ *
+ * @param name a unique task name
+ * @param inputs glob patterns for the files the task reads
+ * @param outputs glob patterns for the files and directories the task writes
+ * @param environment names of the environment variables which affect the task
+ * @returns a hexadecimal digest
+ */
+inline std::string OutputKey(const std::string &name, const std::vector<std::string> &inputs, const std::vector<std::string> &outputs, const std::vector<std::string> &environment) {
+    std::uint64_t h{ HashBytes(name.data(), name.size() + 1, 0) };
+
+    // Declaring new outputs must miss entries which lack them.
+    for (const std::string &pattern : outputs) {
+        h = HashBytes(pattern.data(), pattern.size() + 1, h);
+    }
+
+    for (const std::string &key : environment) {
+        h = HashBytes(key.data(), key.size() + 1, h);
+
+        // Avoid GetEnvironmentVariable, which is only available when linking rez itself.
+        const char *value{ getenv(key.c_str()) };
+        h = HashBytes(value != nullptr ? "+" : "-", 1, h);
+
+        if (value != nullptr) {
+            h = HashBytes(value, strlen(value) + 1, h);
+        }
+    }
+
+    h = DigestFiles(inputs, h);
+    constexpr char digits[]{ "0123456789abcdef" };
+    std::string key(16, '0');
+
+    for (std::size_t i{ 0 }; i < key.size(); i++) {
+        key[key.size() - 1 - i] = digits[(h >> (4 * i)) & 0xf];
+    }
+
+    return key;
+}
+
+/**
+ * @brief OutputFiles lists the files matching a set of glob patterns, descending into matched directories.
+ *
+ * @param outputs glob patterns, per @ref ExpandGlob
+ * @returns existing file paths
+ */
+inline std::vector<std::filesystem::path> OutputFiles(const std::vector<std::string> &outputs) {
+    std::vector<std::filesystem::path> files;
+    std::error_code ec;
+
+    for (const std::string &pattern : outputs) {
+        for (const std::filesystem::path &path : ExpandGlob(pattern)) {
+            if (std::filesystem::is_regular_file(path, ec)) {
+                files.push_back(path);
+                continue;
+            }
+
+            if (!std::filesystem::is_directory(path, ec)) {
+                continue;
+            }
+
+            for (auto it{ std::filesystem::recursive_directory_iterator(path, ec) }; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+                if (it->is_regular_file(ec)) {
+                    files.push_back(it->path());
+                }
+            }
+        }
+    }
+
+    return files;
+}
+
+/**
+ * @brief RestoreOutputs replaces a task's outputs with those from an output cache entry.
+ *
+ * The declared outputs are removed first, so that files left behind by other runs do not linger inside of output directories.
+ *
+ * @param key an @ref OutputKey
+ * @param outputs glob patterns for the files and directories the task writes, inside of the current working directory
+ * @returns true on a cache hit
+ *
+ * @throws an error in the event of a problem
+ */
+inline bool RestoreOutputs(const std::string &key, const std::vector<std::string> &outputs) {
+    const std::filesystem::path entry_path{ std::filesystem::path(CacheDir) / OutputCacheDirBasename / key };
+    std::ifstream manifest(entry_path / OutputManifestBasename);
+
+    if (!manifest) {
+        return false;
+    }
+
+    std::vector<std::filesystem::path> stored_outputs;
+    std::string line;
+
+    while (getline(manifest, line)) {
+        if (!std::filesystem::exists(entry_path / "files" / line)) {
+            return false;
+        }
+
+        stored_outputs.emplace_back(line);
+    }
+
+    for (const std::string &pattern : outputs) {
+        for (const std::filesystem::path &path : ExpandGlob(pattern)) {
+            const std::filesystem::path relative{ path.lexically_normal() };
+
+            if (relative.is_absolute() || relative.empty() || *relative.begin() == ".." || relative == ".") {
+                throw std::runtime_error("error restoring output outside of the working directory: " + path.string());
+            }
+
+            RemoveTree(relative);
+        }
+    }
+
+    for (const std::filesystem::path &output : stored_outputs) {
+        if (output.has_parent_path()) {
+            std::filesystem::create_directories(output.parent_path());
+        }
+
+        // Replace outputs whole, so that readers never observe partial files.
+        std::filesystem::path temp_path{ output };
+        temp_path += ".rez-tmp" + std::to_string(CurrentProcessId());
+        std::filesystem::copy_file(entry_path / "files" / output, temp_path, std::filesystem::copy_options::overwrite_existing);
+        std::filesystem::rename(temp_path, output);
+    }
+
+    return true;
+}
+
+/**
+ * @brief StoreOutputs copies a task's outputs into an output cache entry.
+ *
+ * Entries are copies rather than hard links, so that tools which later rewrite outputs in place cannot corrupt the cache.
+ *
+ * @param key an @ref OutputKey
+ * @param outputs glob patterns for the files the task writes, inside of the current working directory
+ *
+ * @throws an error in the event of a problem
+ */
+inline void StoreOutputs(const std::string &key, const std::vector<std::string> &outputs) {
+    const std::filesystem::path entry_path{ std::filesystem::path(CacheDir) / OutputCacheDirBasename / key };
+
+    if (std::filesystem::exists(entry_path / OutputManifestBasename)) {
+        return;
+    }
+
+    std::filesystem::path staging_path{ entry_path };
+    staging_path += ".tmp" + std::to_string(CurrentProcessId());
+    std::filesystem::remove_all(staging_path);
+    std::filesystem::create_directories(staging_path / "files");
+    std::string manifest;
+
+    for (const std::filesystem::path &output : OutputFiles(outputs)) {
+        const std::filesystem::path relative{ output.lexically_normal() };
+
+        if (relative.is_absolute() || relative.empty() || *relative.begin() == "..") {
+            std::filesystem::remove_all(staging_path);
+            throw std::runtime_error("error caching output outside of the working directory: " + output.string());
+        }
+
+        const std::filesystem::path stored_path{ staging_path / "files" / relative };
+        std::filesystem::create_directories(stored_path.parent_path());
+        std::filesystem::copy_file(output, stored_path);
+        manifest += relative.generic_string() + "\n";
+    }
+
+    {
+        std::ofstream f(staging_path / OutputManifestBasename, std::ios::binary | std::ios::trunc);
+        f << manifest;
+
+        if (!f) {
+            throw std::runtime_error("error writing output manifest: " + (staging_path / OutputManifestBasename).string());
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(staging_path, entry_path, ec);
+
+    if (ec) {
+        // A concurrent run stored the same entry first.
+        std::filesystem::remove_all(staging_path);
+    }
+}
+
+/**
+ * @brief Cached wraps a deterministic task, restoring its outputs from the output cache rather than rerunning it.
+ *
+ * Entries are keyed by the task name, the contents of its inputs, the output patterns, and the values of the named environment variables. The task is skipped outright while its inputs and outputs are unchanged since its last run, per @ref UpToDate.
+ *
+ * Example:
+ *
+ * @code
+ * tasks.Add("docs", {}, rez::Cached("docs", { "Doxyfile", "README.md" }, { "html" }, { "DOXYGEN_VERSION" }, docs));
+ * @endcode
+ *
+ * @param name a unique task name
+ * @param inputs glob patterns for the files the task reads
+ * @param outputs glob patterns for the files and directories the task writes
+ * @param environment names of the environment variables which affect the task
+ * @param run the task body
+ * @returns a task body
+ */
+inline std::function<int()> Cached(std::string name, std::vector<std::string> inputs, std::vector<std::string> outputs, std::vector<std::string> environment, std::function<int()> run) {
+    return [name = std::move(name), inputs = std::move(inputs), outputs = std::move(outputs), environment = std::move(environment), run = std::move(run)]() -> int {
+        const std::string key{ OutputKey(name, inputs, outputs, environment) };
+
+        // Stamp per environment, so that changing the environment is never up to date.
+        const std::string stamp_name{ name + "@" + OutputKey(name, {}, outputs, environment) };
+
+        // Stamp individual files, so that deleting a file inside of an output directory is noticed.
+        const auto output_files = [&outputs] {
+            std::vector<std::string> files;
+
+            for (const std::filesystem::path &file : OutputFiles(outputs)) {
+                files.push_back(file.generic_string());
+            }
+
+            return files;
+        };
+
+        // Save the state database once per run, here or via MarkUpToDate.
+        StateDatabase &db = StateDatabase::Instance();
+        const std::optional<std::uint64_t> stamp{ db.Stamp(stamp_name) };
+
+        if (stamp.has_value() && *stamp == DigestFiles(output_files(), DigestFiles(inputs, 0))) {
+            db.Save();
+            return EXIT_SUCCESS;
+        }
+
+        try {
+            if (RestoreOutputs(key, outputs)) {
+                MarkUpToDate(stamp_name, inputs, output_files());
+                return EXIT_SUCCESS;
+            }
+        } catch (const std::exception &err) {
+            std::cerr << err.what() << "\n";
+        }
+
+        const int status{ run() };
+
+        if (status != EXIT_SUCCESS) {
+            return status;
+        }
+
+        try {
+            StoreOutputs(key, outputs);
+            MarkUpToDate(stamp_name, inputs, output_files());
+        } catch (const std::exception &err) {
+            std::cerr << err.what() << "\n";
+        }
+
+        return status;
+    };
+}
 }
+#endif
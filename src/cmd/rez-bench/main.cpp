@@ -0,0 +1,250 @@
+/**
+ * @copyright 2021 YelloSoft
+ */
+
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "rez/rez.hpp"
+
+/**
+ * @brief ColdRuns denotes the number of timed delegate builds per example.
+ */
+static constexpr std::size_t ColdRuns{ 3 };
+
+/**
+ * @brief WarmRuns denotes the number of timed cached invocations per example.
+ */
+static constexpr std::size_t WarmRuns{ 10 };
+
+/**
+ * @brief MicroDuration denotes the minimum sampling time per microbenchmark.
+ */
+static constexpr std::chrono::milliseconds MicroDuration{ 500 };
+
+/**
+ * @brief Examples lists the example projects timed end to end.
+ */
+static const std::vector<std::string> Examples{ "athena", "solarsystem" };
+
+/**
+ * @brief Sink defeats dead code elimination of microbenchmark results.
+ */
+static volatile std::size_t Sink{ 0 };
+
+/**
+ * @brief Usage emits operational documentation.
+ *
+ * @param program the invoked name of this program
+ */
+static void Usage(const std::string_view &program) {
+    std::cerr << "usage: " << program << " <rez binary> <rez source directory> [<output json>]\n";
+}
+
+/**
+ * @brief Micro times a function, repeating it for at least MicroDuration.
+ *
+ * @param name the benchmark name
+ * @param f the function under test
+ * @returns a JSON object
+ */
+static std::string Micro(const std::string &name, const std::function<void()> &f) {
+    // Warm up caches, lazy initialization, and the page cache.
+    f();
+
+    std::size_t iterations{ 0 };
+    const auto start{ std::chrono::steady_clock::now() };
+    auto elapsed{ std::chrono::steady_clock::duration::zero() };
+
+    while (elapsed < MicroDuration) {
+        f();
+        iterations++;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+
+    const double ns_per_op{ static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / static_cast<double>(iterations) };
+
+    std::cerr << name << ": " << ns_per_op << " ns/op\n";
+
+    std::stringstream ss;
+    ss << "{ \"name\": \"" << name << "\", \"iterations\": " << iterations << ", \"ns_per_op\": " << ns_per_op << " }";
+    return ss.str();
+}
+
+/**
+ * @brief Invoke runs a command quietly, timing it.
+ *
+ * @param argv the command
+ * @returns milliseconds elapsed
+ *
+ * @throws an error when the command fails
+ */
+static double Invoke(const std::vector<std::string> &argv) {
+    const auto start{ std::chrono::steady_clock::now() };
+    rez::Process process(argv, rez::RunOptions{ true, true });
+    const int status{ process.Wait() };
+    const auto elapsed{ std::chrono::steady_clock::now() - start };
+
+    if (status != EXIT_SUCCESS) {
+        throw std::runtime_error("error running benchmark command: " + rez::JoinArguments(argv) + "\n" + process.Stderr());
+    }
+
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()) / 1000.0;
+}
+
+/**
+ * @brief EndToEnd times repeated invocations of a scenario.
+ *
+ * @param example the example name
+ * @param scenario the scenario name
+ * @param runs the number of timed runs
+ * @param setup an untimed step before each run
+ * @param argv the timed command
+ * @returns a JSON object
+ *
+ * @throws an error in the event of a problem
+ */
+static std::string EndToEnd(const std::string &example, const std::string &scenario, std::size_t runs, const std::function<void()> &setup, const std::vector<std::string> &argv) {
+    std::vector<double> samples;
+
+    for (std::size_t i{ 0 }; i < runs; i++) {
+        setup();
+        samples.push_back(Invoke(argv));
+    }
+
+    std::sort(samples.begin(), samples.end());
+    double total{ 0 };
+
+    for (const double sample : samples) {
+        total += sample;
+    }
+
+    const double median{ samples[samples.size() / 2] };
+    std::cerr << example << " " << scenario << ": " << median << " ms (median)\n";
+
+    std::stringstream ss;
+    ss << "{ \"example\": \"" << example << "\", \"scenario\": \"" << scenario << "\", \"runs\": " << runs
+       << ", \"min_ms\": " << samples.front() << ", \"median_ms\": " << median << ", \"mean_ms\": " << total / static_cast<double>(runs) << " }";
+    return ss.str();
+}
+
+/**
+ * @brief main is the entrypoint.
+ *
+ * Examples are copied to a temporary directory, so that benchmarking leaves the source tree clean.
+ *
+ * @param argc argument count
+ * @param argv CLI arguments
+ * @returns CLI exit code
+ */
+int main(int argc, const char **argv) {
+    const std::vector<std::string_view> args{ argv, argv + argc };
+
+    if (args.size() < 3) {
+        Usage(args.empty() ? "rez-bench" : args[0]);
+        return EXIT_FAILURE;
+    }
+
+    const std::filesystem::path rez_path{ std::filesystem::absolute(std::filesystem::path(args[1])) };
+    const std::filesystem::path source_dir{ std::filesystem::absolute(std::filesystem::path(args[2])) };
+    const std::filesystem::path output_path{ std::filesystem::absolute(args.size() > 3 ? std::filesystem::path(args[3]) : std::filesystem::path("bench.json")) };
+    const std::filesystem::path work_dir{ std::filesystem::temp_directory_path() / ("rez-bench-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count())) };
+
+    std::vector<std::string> micro_results;
+    std::vector<std::string> e2e_results;
+
+    try {
+        const std::string cppflags{ rez::GetEnvironmentVariable("CPPFLAGS").value_or("") };
+        rez::ExportEnvironmentVariable("CPPFLAGS", cppflags + " -I" + (source_dir / "include").string());
+
+        if (!rez::GetEnvironmentVariable("CXXFLAGS").has_value()) {
+            rez::ExportEnvironmentVariable("CXXFLAGS", "-std=c++17");
+        }
+
+        for (const std::string &example : Examples) {
+            const std::filesystem::path example_dir{ work_dir / example };
+            std::filesystem::create_directories(example_dir);
+
+            for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(source_dir / "examples" / example)) {
+                const std::string basename{ entry.path().filename().string() };
+
+                if (basename != rez::CacheDir && basename != "build" && basename != "bin") {
+                    std::filesystem::copy(entry.path(), example_dir / basename, std::filesystem::copy_options::recursive);
+                }
+            }
+
+            std::filesystem::current_path(example_dir);
+
+            // -l builds the delegate as needed, and lists tasks without running them.
+            e2e_results.push_back(EndToEnd(example, "cold", ColdRuns, [] { std::filesystem::remove_all(rez::CacheDir); }, { rez_path.string(), "-l" }));
+            e2e_results.push_back(EndToEnd(example, "warm", WarmRuns, [] {}, { rez_path.string(), "-l" }));
+            e2e_results.push_back(EndToEnd(example, "noop", WarmRuns, [] {}, { rez_path.string(), "-v" }));
+        }
+
+        // Microbenchmark against the warm athena cache.
+        std::filesystem::current_path(work_dir / Examples.front());
+
+        micro_results.push_back(Micro("GetEnvironmentVariable", [] {
+            Sink = Sink + rez::GetEnvironmentVariable("PATH").value_or("").size();
+        }));
+
+        micro_results.push_back(Micro("ApplyBinaryExtension", [] {
+            Sink = Sink + rez::ApplyBinaryExtension(rez::ArtifactFileBasenameUnix, true).native().size();
+        }));
+
+        micro_results.push_back(Micro("Config::Load", [] {
+            rez::Config config;
+            config.Load();
+            Sink = Sink + config.build_argv.size();
+        }));
+
+        rez::Config config;
+        config.Load();
+
+        micro_results.push_back(Micro("Config::ArtifactCacheMiss", [&config] {
+            if (config.ArtifactCacheMiss()) {
+                throw std::runtime_error("error: expected a delegate cache hit");
+            }
+        }));
+    } catch (const std::exception &err) {
+        std::cerr << err.what() << "\n";
+        std::filesystem::current_path(source_dir);
+        std::filesystem::remove_all(work_dir);
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::current_path(source_dir);
+    std::filesystem::remove_all(work_dir);
+
+    std::ofstream output(output_path, std::ios::trunc);
+    output << "{\n  \"micro\": [\n";
+
+    for (std::size_t i{ 0 }; i < micro_results.size(); i++) {
+        output << "    " << micro_results[i] << (i + 1 < micro_results.size() ? ",\n" : "\n");
+    }
+
+    output << "  ],\n  \"e2e\": [\n";
+
+    for (std::size_t i{ 0 }; i < e2e_results.size(); i++) {
+        output << "    " << e2e_results[i] << (i + 1 < e2e_results.size() ? ",\n" : "\n");
+    }
+
+    output << "  ]\n}\n";
+
+    if (!output) {
+        std::cerr << "error writing benchmark results: " << output_path.string() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cerr << "wrote " << output_path.string() << "\n";
+    return EXIT_SUCCESS;
+}
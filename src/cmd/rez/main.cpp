@@ -4,12 +4,48 @@
 
 #include <cstdlib>
 
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
 #include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "rez/rez.hpp"
 
+/**
+ * @brief StatsRecent denotes the number of most recent successful runs which --stats compares against the baseline.
+ */
+static constexpr std::size_t StatsRecent{ 10 };
+
+/**
+ * @brief StatsBaseline denotes the maximum number of successful runs, preceding the recent runs, which form the baseline.
+ */
+static constexpr std::size_t StatsBaseline{ 50 };
+
+/**
+ * @brief StatsMinimumBaseline denotes the number of baseline runs required before flagging regressions.
+ */
+static constexpr std::size_t StatsMinimumBaseline{ 5 };
+
+/**
+ * @brief StatsRegressionRatio denotes the median slowdown, relative to the baseline, which --stats flags as a regression.
+ */
+static constexpr double StatsRegressionRatio{ 1.25 };
+
+/**
+ * @brief StatsRegressionFloor denotes the minimum median slowdown in microseconds which --stats flags, ignoring noise in quick tasks.
+ */
+static constexpr std::int64_t StatsRegressionFloor{ 100000 };
+
 /**
  * @brief Usage emits operational documentation.
  *
@@ -20,6 +56,12 @@ void Usage(const std::string_view &program) {
     std::cerr << "-l\tList available tasks\n"
               << "-c\tClean rez internal cache\n"
               << "-d\tEnable debugging information\n"
+              << "-j <n>\tRun up to n tasks concurrently, sharing a make jobserver\n"
+              << "-p <file>\tWrite a Chrome trace of rez and delegate tasks\n"
+              << "-w\tRerun tasks when the task definition changes\n"
+              << "-W <path>\tAlso watch a file or directory tree (implies -w)\n"
+              << "-s\tServe tasks to later rez invocations from a resident process\n"
+              << "--stats\tShow task duration percentiles, flagging regressions\n"
               << "-v\tShow version information\n"
               << "-h\tShow usage information\n";
 }
@@ -31,6 +73,605 @@ void Banner() {
     std::cout << "rez " << rez::Version << "\n";
 }
 
+/**
+ * @brief TrimHistory compacts the history once it grows past HistoryCompactionSize.
+ */
+static void TrimHistory() {
+    if (!rez::History::Instance().Enabled()) {
+        return;
+    }
+
+    try {
+        const std::filesystem::path history_path{ std::filesystem::path(rez::CacheDir) / rez::HistoryBasename };
+        std::error_code ec;
+
+        if (std::filesystem::file_size(history_path, ec) > rez::HistoryCompactionSize && !ec) {
+            rez::CompactHistory(history_path);
+        }
+    } catch (const std::exception &err) {
+        std::cerr << err.what() << "\n";
+    }
+}
+
+/**
+ * @brief RecordRun appends a delegate run to the history.
+ *
+ * @param tasks task arguments
+ * @param start the start time, per rez::Trace::Now
+ * @param cpu the CPU time in microseconds, or zero where unavailable
+ * @param status the delegate exit status
+ */
+static void RecordRun(const std::vector<std::string_view> &tasks, std::int64_t start, std::int64_t cpu, int status) {
+    rez::History &history = rez::History::Instance();
+
+    if (!history.Enabled()) {
+        return;
+    }
+
+    std::string name{ "rez" };
+
+    for (const std::string_view &task : tasks) {
+        name += " ";
+        name += task;
+    }
+
+    history.Append(rez::HistoryRecord{ name, start, rez::Trace::Now() - start, cpu, status });
+    TrimHistory();
+}
+
+/**
+ * @brief FormatDuration renders a duration for humans.
+ *
+ * @param us microseconds
+ * @returns a duration in milliseconds, seconds, or minutes
+ */
+static std::string FormatDuration(std::int64_t us) {
+    std::stringstream ss;
+
+    if (us < 10000000) {
+        ss << us / 1000 << "ms";
+    } else if (us < 600000000) {
+        ss << std::fixed << std::setprecision(1) << static_cast<double>(us) / 1000000.0 << "s";
+    } else {
+        ss << us / 60000000 << "m" << std::setw(2) << std::setfill('0') << (us / 1000000) % 60 << "s";
+    }
+
+    return ss.str();
+}
+
+/**
+ * @brief Percentile selects a nearest-rank percentile.
+ *
+ * @param sorted ascending samples, not empty
+ * @param p a percentile in [0, 100]
+ * @returns a sample
+ */
+static std::int64_t Percentile(const std::vector<std::int64_t> &sorted, std::size_t p) {
+    const std::size_t rank{ (p * sorted.size() + 99) / 100 };
+    return sorted[std::min(std::max(rank, static_cast<std::size_t>(1)), sorted.size()) - 1];
+}
+
+/**
+ * @brief Median computes a nearest-rank median.
+ *
+ * @param samples samples, not empty
+ * @returns a sample
+ */
+static std::int64_t Median(std::vector<std::int64_t> samples) {
+    std::sort(samples.begin(), samples.end());
+    return Percentile(samples, 50);
+}
+
+/**
+ * @brief Stats summarizes the run history: wall time percentiles per delegate run and task, flagging regressions.
+ *
+ * Percentiles cover successful runs, or all runs for names which never succeeded. The median of the StatsRecent most recent successful runs is compared against the median of up to StatsBaseline successful runs before them.
+ *
+ * @returns CLI exit code
+ */
+static int Stats() {
+    const std::vector<rez::HistoryRecord> records{ rez::ReadHistory(std::filesystem::path(rez::CacheDir) / rez::HistoryBasename) };
+
+    if (records.empty()) {
+        std::cout << "no runs recorded\n";
+        return EXIT_SUCCESS;
+    }
+
+    std::map<std::string, std::vector<const rez::HistoryRecord *>> runs_by_name;
+
+    for (const rez::HistoryRecord &record : records) {
+        runs_by_name[record.name].push_back(&record);
+    }
+
+    std::size_t name_width{ 4 };
+
+    for (const auto &[name, _] : runs_by_name) {
+        name_width = std::max(name_width, name.size());
+    }
+
+    std::cout << std::left << std::setw(static_cast<int>(name_width)) << "NAME" << std::right
+              << std::setw(7) << "RUNS" << std::setw(7) << "FAIL" << std::setw(9) << "P50" << std::setw(9) << "P95" << std::setw(9) << "MAX" << std::setw(9) << "CPU50" << "\n";
+
+    for (const auto &[name, runs] : runs_by_name) {
+        std::vector<std::int64_t> walls, cpus, all_walls;
+        std::size_t failures{ 0 };
+
+        for (const rez::HistoryRecord *run : runs) {
+            all_walls.push_back(run->wall);
+
+            if (run->status != EXIT_SUCCESS) {
+                failures++;
+                continue;
+            }
+
+            walls.push_back(run->wall);
+            cpus.push_back(run->cpu);
+        }
+
+        if (walls.empty()) {
+            walls = all_walls;
+            cpus = { 0 };
+        }
+
+        // Chronological successes, for the rolling baseline.
+        const std::vector<std::int64_t> chronological{ walls };
+        std::sort(walls.begin(), walls.end());
+        std::sort(cpus.begin(), cpus.end());
+
+        std::cout << std::left << std::setw(static_cast<int>(name_width)) << name << std::right
+                  << std::setw(7) << runs.size() << std::setw(7) << failures
+                  << std::setw(9) << FormatDuration(Percentile(walls, 50))
+                  << std::setw(9) << FormatDuration(Percentile(walls, 95))
+                  << std::setw(9) << FormatDuration(walls.back())
+                  << std::setw(9) << (cpus.back() == 0 ? "-" : FormatDuration(Percentile(cpus, 50)));
+
+        if (failures < runs.size() && chronological.size() >= StatsRecent + StatsMinimumBaseline) {
+            const auto recent_begin{ chronological.end() - static_cast<std::ptrdiff_t>(StatsRecent) };
+            const auto baseline_begin{ recent_begin - static_cast<std::ptrdiff_t>(std::min(StatsBaseline, chronological.size() - StatsRecent)) };
+            const std::int64_t recent{ Median(std::vector<std::int64_t>(recent_begin, chronological.end())) };
+            const std::int64_t baseline{ Median(std::vector<std::int64_t>(baseline_begin, recent_begin)) };
+
+            if (static_cast<double>(recent) > static_cast<double>(baseline) * StatsRegressionRatio && recent - baseline > StatsRegressionFloor) {
+                std::cout << "  REGRESSED " << FormatDuration(baseline) << " -> " << FormatDuration(recent);
+            }
+        }
+
+        std::cout << "\n";
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Prepare ensures that the delegate is current, building it as needed.
+ *
+ * @param config a loaded configuration
+ * @returns EXIT_SUCCESS when the delegate is ready to run
+ */
+static int Prepare(rez::Config &config) {
+    bool artifact_cache_miss{ true };
+
+    try {
+        const rez::Span span("cache check", "rez");
+        artifact_cache_miss = config.ArtifactCacheMiss();
+    } catch (const std::exception &err) {
+        std::cerr << err.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::optional<rez::FileLock> build_lock;
+
+    if (artifact_cache_miss) {
+        try {
+            // Concurrent rez processes queue here while the first builds, then reuse its delegate.
+            const rez::Span span("lock", "rez");
+            build_lock.emplace(std::filesystem::path(rez::CacheDir) / rez::LockFileBasename);
+            artifact_cache_miss = config.ArtifactCacheMiss();
+        } catch (const std::exception &err) {
+            std::cerr << err.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (artifact_cache_miss) {
+        try {
+            const rez::Span span("shared cache", "rez");
+            artifact_cache_miss = !config.RestoreSharedArtifact();
+        } catch (const std::exception &err) {
+            // The shared store is an optimization. Fall back to building.
+            if (config.debug) {
+                std::cerr << err.what() << "\n";
+            }
+        }
+    }
+
+    if (artifact_cache_miss) {
+        std::filesystem::create_directories(config.artifact_dir_path);
+        std::vector<std::filesystem::path> inputs;
+        std::string inputs_digest;
+        const std::filesystem::file_time_type build_start{ std::filesystem::file_time_type::clock::now() };
+
+        try {
+            // Snapshot the sources, so that edits made while compiling leave the delegate unrecorded.
+            inputs = config.BuildInputs();
+            inputs_digest = config.DigestInputs(inputs);
+            config.BuildPrecompiledHeader();
+
+            const int module_status{ config.BuildModule() };
+
+            if (module_status != EXIT_SUCCESS) {
+                return module_status;
+            }
+        } catch (const std::exception &err) {
+            std::cerr << err.what() << "\n";
+            return EXIT_FAILURE;
+        }
+
+        int build_status{ EXIT_FAILURE };
+
+        try {
+            build_status = config.BuildObjects();
+
+            if (build_status == EXIT_SUCCESS) {
+                if (config.debug) {
+                    std::cerr << "running build command: " << rez::JoinArguments(config.build_argv) << "\n";
+                }
+
+                const rez::Span span(config.translation_units.empty() ? "compile" : "link", "rez");
+                build_status = rez::Spawn(config.build_argv);
+            }
+        } catch (const std::exception &err) {
+            std::cerr << err.what() << "\n";
+        }
+
+        if (build_status != EXIT_SUCCESS) {
+            std::cerr << "error building task file: " << config.task_definition_path.string() << "\n";
+            return build_status;
+        }
+
+        try {
+            config.CommitArtifact();
+
+            if (config.InputsChanged(inputs, inputs_digest, build_start)) {
+                // Run this delegate once, but rebuild it next time.
+                if (config.debug) {
+                    std::cerr << "sources changed during build: " << config.task_definition_path.string() << "\n";
+                }
+
+                config.ForgetCacheKey();
+                return EXIT_SUCCESS;
+            }
+
+            config.SaveCacheKey();
+        } catch (const std::exception &err) {
+            std::cerr << err.what() << "\n";
+            return EXIT_FAILURE;
+        }
+
+        try {
+            config.PublishSharedArtifact();
+        } catch (const std::exception &err) {
+            if (config.debug) {
+                std::cerr << err.what() << "\n";
+            }
+        }
+    }
+
+    // Returning releases the lock, so that tasks may run rez themselves.
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief RunResident runs the delegate to completion, keeping the rez process alive.
+ *
+ * Shared object delegates run in process. A rebuilt shared object loads under a fresh name, because the dynamic loader may retain an earlier image of the same path.
+ *
+ * @param config a loaded configuration
+ * @param run_argv delegate arguments, including the program name
+ * @param generation the number of times that the delegate has been rebuilt by this process
+ * @returns the delegate exit status
+ */
+static int RunResident(const rez::Config &config, const std::vector<std::string> &run_argv, std::size_t generation) {
+    try {
+        const rez::Span span("delegate", "rez");
+
+        if (config.delegate_mode != rez::DelegateMode::SharedObject) {
+            return rez::Spawn(run_argv);
+        }
+
+        if (generation == 0) {
+            return rez::RunSharedObject(config.artifact_file_path, run_argv);
+        }
+
+        const std::filesystem::path generation_path{ config.artifact_dir_path / (config.artifact_file_path.stem().string() + "-" + std::to_string(generation) + config.artifact_file_path.extension().string()) };
+        std::filesystem::remove(generation_path);
+        std::filesystem::copy_file(config.artifact_file_path, generation_path);
+        const int status{ rez::RunSharedObject(generation_path, run_argv) };
+        std::filesystem::remove(generation_path);
+        return status;
+    } catch (const std::exception &err) {
+        std::cerr << err.what() << "\n";
+        return EXIT_FAILURE;
+    }
+}
+
+/**
+ * @brief WatchDefinition watches the task definition sources and the headers they include.
+ *
+ * @param config a loaded configuration
+ * @param watcher a watcher
+ * @returns the absolute paths whose changes may require rebuilding the delegate
+ *
+ * @throws an error in the event of a problem
+ */
+static std::set<std::filesystem::path> WatchDefinition(const rez::Config &config, rez::Watcher &watcher) {
+    std::vector<std::filesystem::path> paths{ config.PrecompiledHeaderDependencies() };
+    const std::vector<std::filesystem::path> module_dependencies{ config.ModuleDependencies() };
+    paths.insert(paths.end(), module_dependencies.begin(), module_dependencies.end());
+
+    if (config.translation_units.empty()) {
+        paths.push_back(config.task_definition_path);
+        const std::vector<std::filesystem::path> dependencies{ config.Dependencies() };
+        paths.insert(paths.end(), dependencies.begin(), dependencies.end());
+    } else {
+        // Observe sources added to the task definition directory.
+        watcher.Add(config.task_definition_path);
+
+        for (const rez::TranslationUnit &translation_unit : config.translation_units) {
+            paths.push_back(translation_unit.source_path);
+            const std::vector<std::filesystem::path> dependencies{ config.Dependencies(translation_unit.depfile_path, translation_unit.source_path) };
+            paths.insert(paths.end(), dependencies.begin(), dependencies.end());
+        }
+    }
+
+    std::set<std::filesystem::path> definition;
+
+    for (const std::filesystem::path &path : paths) {
+        const std::filesystem::path absolute{ std::filesystem::absolute(path).lexically_normal() };
+        watcher.Add(absolute);
+        definition.insert(absolute);
+    }
+
+    return definition;
+}
+
+/**
+ * @brief Refresh rebuilds the delegate as needed after watched paths change.
+ *
+ * @param config a loaded configuration, reloaded when sources are added to or removed from a task definition directory
+ * @param watcher a watcher
+ * @param definition the paths from @ref WatchDefinition, updated on rebuild
+ * @param changes the changed paths
+ * @param ready whether the delegate is ready to run, updated on rebuild
+ * @returns true when the delegate was rebuilt
+ *
+ * @throws an error in the event of a problem
+ */
+static bool Refresh(rez::Config &config, rez::Watcher &watcher, std::set<std::filesystem::path> &definition, const std::vector<std::filesystem::path> &changes, bool &ready) {
+    const std::filesystem::path definition_root{ std::filesystem::absolute(config.task_definition_path).lexically_normal() };
+    bool rebuild{ false };
+    bool reload{ false };
+
+    for (const std::filesystem::path &change : changes) {
+        if (config.debug) {
+            std::cerr << "changed: " << change.string() << "\n";
+        }
+
+        const std::filesystem::path relative{ change.lexically_relative(definition_root) };
+
+        if (definition.find(change) != definition.end()) {
+            rebuild = true;
+        } else if (!config.translation_units.empty() && !relative.empty() && *relative.begin() != "..") {
+            reload = true;
+        }
+    }
+
+    if (reload) {
+        // Sources were added to or removed from the task definition directory.
+        const bool debug{ config.debug };
+        config = rez::Config{};
+        config.debug = debug;
+
+        try {
+            config.Load();
+        } catch (const std::exception &err) {
+            std::cerr << err.what() << "\n";
+            ready = false;
+            return false;
+        }
+    }
+
+    if (!rebuild && !reload) {
+        return false;
+    }
+
+    ready = Prepare(config) == EXIT_SUCCESS;
+    definition = WatchDefinition(config, watcher);
+    return true;
+}
+
+/**
+ * @brief Watch reruns tasks whenever watched paths change, until interrupted.
+ *
+ * The delegate is rebuilt only when the task definition or its headers change. Changes made while tasks run, such as build outputs, are discarded.
+ *
+ * @param config a loaded configuration
+ * @param tasks task names
+ * @param watch_paths additional files and directory trees to watch
+ * @returns CLI exit code
+ */
+static int Watch(rez::Config &config, const std::vector<std::string_view> &tasks, const std::vector<std::filesystem::path> &watch_paths) {
+    try {
+        rez::Watcher watcher;
+
+        for (const std::filesystem::path &watch_path : watch_paths) {
+            watcher.Add(watch_path);
+        }
+
+        // Building first records the headers to watch.
+        bool ready{ Prepare(config) == EXIT_SUCCESS };
+        std::set<std::filesystem::path> definition{ WatchDefinition(config, watcher) };
+        std::size_t generation{ 0 };
+
+        for (;;) {
+            if (ready) {
+                std::vector<std::string> run_argv{ config.artifact_file_path.string() };
+                run_argv.insert(run_argv.end(), tasks.begin(), tasks.end());
+
+                if (config.debug) {
+                    std::cerr << "running command: " << rez::JoinArguments(run_argv) << "\n";
+                }
+
+                const std::int64_t start{ rez::Trace::Now() };
+                const std::int64_t cpu_start{ rez::ProcessCpuTime() };
+                const int status{ RunResident(config, run_argv, generation) };
+                RecordRun(tasks, start, rez::ProcessCpuTime() - cpu_start, status);
+                std::cerr << "rez: " << (status == EXIT_SUCCESS ? "ok" : "failed") << ", watching for changes\n";
+            } else {
+                std::cerr << "rez: watching for changes\n";
+            }
+
+            watcher.Drain();
+
+            if (Refresh(config, watcher, definition, watcher.Wait(rez::WatchDebounce), ready)) {
+                generation++;
+            }
+        }
+    } catch (const std::exception &err) {
+        std::cerr << err.what() << "\n";
+        return EXIT_FAILURE;
+    }
+}
+
+/**
+ * @brief ServerState denotes the warm state which a rez server shares between its watcher thread and request threads.
+ */
+struct ServerState {
+    /**
+     * @brief mutex guards the remaining fields, and is held while rebuilding, so that requests never run a stale delegate.
+     */
+    std::mutex mutex{};
+
+    /**
+     * @brief config denotes the resolved configuration.
+     */
+    rez::Config config{};
+
+    /**
+     * @brief watcher observes the task definition and its headers.
+     */
+    rez::Watcher watcher{};
+
+    /**
+     * @brief definition denotes the paths from @ref WatchDefinition.
+     */
+    std::set<std::filesystem::path> definition{};
+
+    /**
+     * @brief ready denotes whether the delegate built successfully.
+     */
+    bool ready{ false };
+};
+
+/**
+ * @brief Serve keeps the delegate current, running it on behalf of rez clients, until interrupted.
+ *
+ * Clients connect to a unix socket in CacheDir. A watcher thread rebuilds the delegate whenever the task definition or its headers change. Each request runs the delegate in the client's working directory, environment, and standard streams. While the delegate fails to build, or when a client's compiler, flags, profile, or toolchain differ from the server's, clients run their tasks themselves.
+ *
+ * @param config a loaded configuration
+ * @param environment_digest the @ref rez::ConfigEnvironmentDigest from before config loaded
+ * @returns CLI exit code
+ */
+static int Serve(const rez::Config &config, const std::string &environment_digest) {
+    if (config.delegate_mode == rez::DelegateMode::SharedObject) {
+        std::cerr << "error: rez server requires an executable delegate\n";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        // The watcher thread outlives this function should accepting fail, so share ownership of its state and the socket it stops.
+        const std::shared_ptr<ServerState> state{ std::make_shared<ServerState>() };
+        state->config = config;
+        const std::shared_ptr<const rez::ServerSocket> server{ std::make_shared<const rez::ServerSocket>(std::filesystem::path(rez::CacheDir) / rez::ServerSocketBasename) };
+
+        {
+            const std::lock_guard<std::mutex> lock(state->mutex);
+            state->ready = Prepare(state->config) == EXIT_SUCCESS;
+            state->definition = WatchDefinition(state->config, state->watcher);
+        }
+
+        // Should rebuilding fail outright, the watcher thread stops the socket, and the accept loop below shuts the server down.
+        std::thread refresher([state, server] {
+            try {
+                for (;;) {
+                    const std::vector<std::filesystem::path> changes{ state->watcher.Wait(rez::WatchDebounce) };
+                    const std::lock_guard<std::mutex> lock(state->mutex);
+                    Refresh(state->config, state->watcher, state->definition, changes, state->ready);
+                }
+            } catch (const std::exception &err) {
+                std::cerr << err.what() << "\n";
+                server->Stop();
+            }
+        });
+
+        std::cerr << "rez: serving on " << (std::filesystem::path(rez::CacheDir) / rez::ServerSocketBasename).string() << "\n";
+
+        try {
+            for (;;) {
+                rez::ServerRequest request;
+                const int connection{ server->Accept(request) };
+
+                if (connection == -1) {
+                    break;
+                }
+
+                std::vector<std::string> run_argv;
+
+                {
+                    const std::lock_guard<std::mutex> lock(state->mutex);
+
+                    if (state->ready) {
+                        run_argv.push_back(std::filesystem::absolute(state->config.artifact_file_path).string());
+                    }
+                }
+
+                if (request.environment_digest != environment_digest) {
+                    if (config.debug) {
+                        std::cerr << "declining client with a different environment\n";
+                    }
+
+                    run_argv.clear();
+                }
+
+                if (run_argv.empty()) {
+                    rez::DeclineRequest(connection, request);
+                    continue;
+                }
+
+                run_argv.insert(run_argv.end(), request.args.begin(), request.args.end());
+
+                if (config.debug) {
+                    std::cerr << "serving command: " << rez::JoinArguments(run_argv) << "\n";
+                }
+
+                std::thread([connection, request = std::move(request), run_argv = std::move(run_argv)] {
+                    rez::ServeRequest(connection, request, run_argv);
+                }).detach();
+            }
+        } catch (const std::exception &) {
+            // The watcher thread waits on the next change, so leave it to exit with the process.
+            refresher.detach();
+            throw;
+        }
+
+        refresher.join();
+        return EXIT_FAILURE;
+    } catch (const std::exception &err) {
+        std::cerr << err.what() << "\n";
+        return EXIT_FAILURE;
+    }
+}
+
 /**
  * @brief main is the entrypoint.
  *
@@ -48,13 +689,22 @@ int main(int argc, const char **argv) {
     }
 
     rez::Config config;
+    bool watch{ false };
+    bool serve{ false };
+    std::vector<std::filesystem::path> watch_paths;
 
     size_t i{ 1 };
     for (; i < args.size(); i++) {
         const std::string_view arg{ args[i] };
 
         if (arg == "-c") {
-            std::filesystem::remove_all(rez::CacheDir);
+            try {
+                rez::RemoveTree(rez::CacheDir);
+            } catch (const std::exception &err) {
+                std::cerr << err.what() << "\n";
+                return EXIT_FAILURE;
+            }
+
             return EXIT_SUCCESS;
         }
 
@@ -63,6 +713,86 @@ int main(int argc, const char **argv) {
             continue;
         }
 
+        if (arg == "-j") {
+            if (i + 1 == args.size()) {
+                Usage(args[0]);
+                return EXIT_FAILURE;
+            }
+
+            const std::string jobs{ args[++i] };
+
+            if (jobs.empty() || jobs.size() > 9 || jobs.find_first_not_of("0123456789") != std::string::npos || std::stoul(jobs) == 0) {
+                std::cerr << "error: -j requires a positive integer\n";
+                return EXIT_FAILURE;
+            }
+
+            try {
+                // Task graphs in rez/rez.hpp read REZ_JOBS via rez::DefaultJobs.
+                rez::ExportEnvironmentVariable("REZ_JOBS", jobs);
+                rez::StartJobserver(std::stoul(jobs));
+            } catch (const std::exception &err) {
+                std::cerr << err.what() << "\n";
+                return EXIT_FAILURE;
+            }
+
+            continue;
+        }
+
+        if (arg == "-p") {
+            if (i + 1 == args.size()) {
+                Usage(args[0]);
+                return EXIT_FAILURE;
+            }
+
+            const std::filesystem::path trace_path{ std::filesystem::absolute(std::filesystem::path(args[++i])) };
+
+            {
+                std::ofstream trace(trace_path, std::ios::trunc);
+
+                if (!trace) {
+                    std::cerr << "error writing trace file: " << trace_path.string() << "\n";
+                    return EXIT_FAILURE;
+                }
+
+                trace << "[\n";
+            }
+
+            try {
+                // The delegate and any nested rez processes append their own events.
+                rez::ExportEnvironmentVariable(rez::TraceFileEnvironmentVariable, trace_path.string());
+            } catch (const std::exception &err) {
+                std::cerr << err.what() << "\n";
+                return EXIT_FAILURE;
+            }
+
+            continue;
+        }
+
+        if (arg == "-w") {
+            watch = true;
+            continue;
+        }
+
+        if (arg == "-W") {
+            if (i + 1 == args.size()) {
+                Usage(args[0]);
+                return EXIT_FAILURE;
+            }
+
+            watch = true;
+            watch_paths.emplace_back(args[++i]);
+            continue;
+        }
+
+        if (arg == "-s") {
+            serve = true;
+            continue;
+        }
+
+        if (arg == "--stats") {
+            return Stats();
+        }
+
         if (arg == "-v") {
             Banner();
             return EXIT_SUCCESS;
@@ -78,50 +808,93 @@ int main(int argc, const char **argv) {
 
     const std::vector<std::string_view> rest{ args.begin() + static_cast<ptrdiff_t>(i), args.end() };
 
+    const bool history{ rez::GetEnvironmentVariable("REZ_HISTORY").value_or("") != "0" };
+
+    if (history) {
+        try {
+            // Task graphs in the delegate append task durations alongside the delegate runs.
+            rez::ExportEnvironmentVariable(rez::HistoryFileEnvironmentVariable, std::filesystem::absolute(std::filesystem::path(rez::CacheDir) / rez::HistoryBasename).string());
+
+            // Only delegates which replace this process record their own runs. Clear any start time inherited from an enclosing delegate.
+            rez::ExportEnvironmentVariable(rez::HistoryStartEnvironmentVariable, "");
+        } catch (const std::exception &err) {
+            std::cerr << err.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Loading the configuration exports toolchain script results, so digest its inputs beforehand.
+    const std::string environment_digest{ rez::ConfigEnvironmentDigest() };
+
+    // Plain task runs go to a rez server, when one listens in this directory.
+    if (i == 1 && rez::GetEnvironmentVariable("REZ_SERVER").value_or("") != "0") {
+        const std::int64_t start{ rez::Trace::Now() };
+        const std::optional<int> status{ rez::ForwardToServer(std::filesystem::path(rez::CacheDir) / rez::ServerSocketBasename, std::vector<std::string>(rest.begin(), rest.end()), environment_digest) };
+
+        if (status.has_value()) {
+            // The server's delegate CPU time is not reported back.
+            RecordRun(rest, start, 0, *status);
+            return *status;
+        }
+    }
+
     try {
+        const rez::Span span("load", "rez");
         config.Load();
     } catch (const std::exception &err) {
         std::cerr << err.what() << "\n";
+        return EXIT_FAILURE;
     }
 
     if (config.debug) {
         std::cerr << config << "\n";
     }
 
-    const bool artifact_cache_miss = !std::filesystem::exists(config.artifact_file_path) ||
-                                     std::filesystem::last_write_time(config.artifact_file_path) < std::filesystem::last_write_time(config.task_definition_path);
-
-    if (artifact_cache_miss) {
-        std::filesystem::create_directories(config.artifact_dir_path);
-        const std::string build_command{ config.build_command };
+    if (serve) {
+        return Serve(config, environment_digest);
+    }
 
-        if (config.debug) {
-            std::cerr << "running build command: " << build_command << "\n";
-        }
+    if (watch) {
+        return Watch(config, rest, watch_paths);
+    }
 
-        const int build_status{ system(build_command.c_str()) };
+    const int prepare_status{ Prepare(config) };
 
-        if (build_status != EXIT_SUCCESS) {
-            std::cerr << "error building task file: " << config.task_definition_path.string() << "\n";
-            return build_status;
-        }
+    if (prepare_status != EXIT_SUCCESS) {
+        return prepare_status;
     }
 
-    std::stringstream ss;
-    ss << config.artifact_file_path.string();
+    std::vector<std::string> run_argv{ config.artifact_file_path.string() };
+    run_argv.insert(run_argv.end(), rest.begin(), rest.end());
 
-    for (const std::string_view &arg : rest) {
-        ss << " ";
-        ss << arg;
+    if (config.debug) {
+        std::cerr << "running command: " << rez::JoinArguments(run_argv) << "\n";
     }
 
-    const std::string run_command{ ss.str() };
+    const std::int64_t start{ rez::Trace::Now() };
 
-    if (config.debug) {
-        std::cerr << "running command: " << run_command << "\n";
+    if (config.delegate_mode == rez::DelegateMode::SharedObject || rez::Trace::Instance().Enabled()) {
+        // Already waiting on the delegate, so record the run alongside its tasks.
+        const std::int64_t cpu_start{ rez::ProcessCpuTime() };
+        const int status{ RunResident(config, run_argv, 0) };
+        RecordRun(rest, start, rez::ProcessCpuTime() - cpu_start, status);
+        return status;
     }
 
-    if (system(run_command.c_str())) {
+    TrimHistory();
+
+    try {
+        // The delegate's rez::TaskGraph::Main records the run on exit.
+        if (history) {
+            rez::ExportEnvironmentVariable(rez::HistoryStartEnvironmentVariable, std::to_string(start) + " " + std::to_string(rez::ProcessCpuTime()));
+        }
+
+        // On success, the delegate replaces this process.
+        if (rez::Exec(run_argv) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception &err) {
+        std::cerr << err.what() << "\n";
         return EXIT_FAILURE;
     }
 
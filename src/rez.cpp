@@ -8,14 +8,35 @@
 #define popen _popen
 #endif
 
+#include <cctype>
 #include <cstdlib>
 #include <cstring>
 
+#if !defined(_WIN32)
+#include <dlfcn.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+#endif
+
+#include <algorithm>
+#include <chrono>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <mutex>
 #include <optional>
+#include <set>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 using std::literals::string_literals::operator""s;
 
@@ -31,6 +52,15 @@ std::ostream &operator<<(std::ostream &os, const Lang &o) {
     }
 }
 
+std::ostream &operator<<(std::ostream &os, const DelegateMode &o) {
+    switch (o) {
+    case DelegateMode::SharedObject:
+        return os << "shared";
+    default:
+        return os << "executable";
+    }
+}
+
 std::filesystem::path ApplyBinaryExtension(const std::filesystem::path &basename, bool windows) {
     std::filesystem::path path(basename);
 
@@ -41,6 +71,66 @@ std::filesystem::path ApplyBinaryExtension(const std::filesystem::path &basename
     return path;
 }
 
+std::filesystem::path ApplySharedLibraryExtension(const std::filesystem::path &basename, bool windows) {
+    std::filesystem::path path(basename);
+
+    if (windows) {
+        path += ".dll";
+    } else {
+#if defined(__APPLE__)
+        path += ".dylib";
+#else
+        path += ".so";
+#endif
+    }
+
+    return path;
+}
+
+int RunSharedObject(const std::filesystem::path &path, const std::vector<std::string> &argv) {
+#if defined(_WIN32)
+    (void) argv;
+    throw std::runtime_error("error loading shared delegate: unsupported on Windows: "s + path.string());
+#else
+    // dlopen searches the library path for names without a directory separator.
+    const std::filesystem::path library_path{ path.has_parent_path() ? path : std::filesystem::path(".") / path };
+
+    void *handle{ dlopen(library_path.c_str(), RTLD_NOW | RTLD_LOCAL) };
+
+    if (handle == nullptr) {
+        throw std::runtime_error("error loading shared delegate: "s + dlerror());
+    }
+
+    using MainFunction = int (*)(int, char **);
+    void *symbol{ dlsym(handle, "main") };
+
+    if (symbol == nullptr) {
+        dlclose(handle);
+        throw std::runtime_error("error locating main in shared delegate: "s + path.string());
+    }
+
+    MainFunction delegate_main{ nullptr };
+    memcpy(&delegate_main, &symbol, sizeof(delegate_main));
+
+    std::vector<std::string> args(argv);
+    std::vector<char *> c_argv;
+
+    for (std::string &arg : args) {
+        c_argv.push_back(arg.data());
+    }
+
+    c_argv.push_back(nullptr);
+
+    const int status{ delegate_main(static_cast<int>(args.size()), c_argv.data()) };
+    std::cout.flush();
+    fflush(stdout);
+
+    // Static destructors registered by the delegate must run before its code unmaps.
+    dlclose(handle);
+    return status;
+#endif
+}
+
 std::optional<std::string> GetEnvironmentVariable(const std::string &key) {
     char *transient{ nullptr };
 
@@ -74,249 +164,3166 @@ std::optional<std::string> GetEnvironmentVariable(const std::string &key) {
     return std::nullopt;
 }
 
-bool DetectWindowsEnvironment() {
-    return GetEnvironmentVariable("COMSPEC").has_value();
-}
+std::optional<std::filesystem::path> FindExecutable(const std::string &name, bool windows) {
+    if (name.empty()) {
+        return std::nullopt;
+    }
 
-void Config::ApplyMSVCToolchain() const {
-    std::filesystem::create_directories(CacheDir);
+    std::vector<std::string> extensions{ "" };
 
-    std::fstream cache{};
-    cache.open(cache_file_path);
+    if (windows) {
+        const std::string pathext{ GetEnvironmentVariable("PATHEXT").value_or(".COM;.EXE;.BAT;.CMD") };
+        std::stringstream ss(pathext);
+        std::string extension;
+
+        while (getline(ss, extension, ';')) {
+            if (!extension.empty()) {
+                extensions.push_back(extension);
+            }
+        }
+    }
 
     std::error_code ec;
-    const std::uintmax_t cache_size{ std::filesystem::file_size(cache_file_path, ec) };
+    const std::filesystem::path name_path(name);
 
-    if (cache_size == static_cast<std::uintmax_t>(-1) || cache_size == 0) {
-        if (debug) {
-            std::cerr << "querying msvc toolchain...\n";
+    if (name_path.has_parent_path()) {
+        for (const std::string &extension : extensions) {
+            std::filesystem::path candidate(name_path);
+            candidate += extension;
+
+            if (std::filesystem::is_regular_file(candidate, ec)) {
+                return candidate;
+            }
         }
 
-        std::string query_path(DefaultMSVCToolchainQueryScript);
-        const std::optional<std::string> query_path_override{ GetEnvironmentVariable("REZ_TOOLCHAIN_QUERY_PATH") };
+        return std::nullopt;
+    }
 
-        if (query_path_override.has_value()) {
-            query_path = *query_path_override;
-        }
+    const std::optional<std::string> path_opt{ GetEnvironmentVariable("PATH") };
+
+    if (!path_opt.has_value()) {
+        return std::nullopt;
+    }
 
-        std::string arch(ArchitectureMsvcAmd64);
-        const std::optional<std::string> arch_override{ GetEnvironmentVariable("REZ_ARCH") };
+    const char path_separator{ windows ? ';' : ':' };
+    std::stringstream ss(*path_opt);
+    std::string dir;
 
-        if (arch_override.has_value()) {
-            arch = *arch_override;
+    while (getline(ss, dir, path_separator)) {
+        if (dir.empty()) {
+            continue;
         }
 
-        std::stringstream ss;
-        ss << R"(cmd.exe /c "")";
-        ss << query_path;
-        ss << R"(" )";
-        ss << arch;
-        ss << R"( && set")";
-        const std::string query_command{ ss.str() };
+        for (const std::string &extension : extensions) {
+            std::filesystem::path candidate{ std::filesystem::path(dir) / name };
+            candidate += extension;
 
-        if (debug) {
-            std::cerr << "running msvc query command: " << query_command << "\n";
+            if (std::filesystem::is_regular_file(candidate, ec)) {
+                return candidate;
+            }
         }
+    }
+
+    return std::nullopt;
+}
 
-        errno = 0;
-        FILE *process{ popen(query_command.c_str(), "r") };
+std::vector<std::filesystem::path> ParseDepfile(const std::string &contents) {
+    std::vector<std::filesystem::path> prerequisites;
+    std::size_t i{ 0 };
 
-        if (process == nullptr) {
-            throw std::runtime_error{ "error launching msvc query command: "s + query_command };
+    // Skip the target, tolerating drive letters such as C:\ in Windows paths.
+    for (; i < contents.size(); i++) {
+        if (contents[i] == '\\' && i + 1 < contents.size()) {
+            i++;
+            continue;
         }
 
-        // https://devblogs.microsoft.com/oldnewthing/20100203-00/?p=15083#:~:text=The%20theoretical%20maximum%20length%20of,a%20limit%20of%2032767%20characters.
-        char line[32760]{ 0 };
+        if (contents[i] == ':' && (i + 1 == contents.size() || isspace(static_cast<unsigned char>(contents[i + 1])) != 0)) {
+            i++;
+            break;
+        }
+    }
+
+    std::string token;
+
+    for (; i < contents.size(); i++) {
+        const char c{ contents[i] };
 
-        while (fgets(line, sizeof(line), process) != nullptr) {
-            if (strchr(line, '=') != nullptr) {
-                cache << line;
+        if (c == '\\' && i + 1 < contents.size()) {
+            const char next{ contents[i + 1] };
+
+            if (next == '\n' || next == '\r') {
+                i++;
+                continue;
+            }
+
+            if (next == ' ' || next == '#' || next == '\\') {
+                token += next;
+                i++;
+                continue;
             }
         }
 
-        const int query_status{ pclose(process) };
+        if (c == '$' && i + 1 < contents.size() && contents[i + 1] == '$') {
+            token += '$';
+            i++;
+            continue;
+        }
 
-        if (query_status != EXIT_SUCCESS) {
-            cache.close();
+        if (isspace(static_cast<unsigned char>(c)) != 0) {
+            if (!token.empty()) {
+                prerequisites.emplace_back(token);
+                token.clear();
+            }
 
-            std::stringstream err;
-            err << "error running query command: "
-                << query_command
-                << " status: " << query_status;
-            throw std::runtime_error{ err.str() };
+            continue;
         }
 
-        cache.seekg(0);
+        token += c;
     }
 
-    std::string line;
+    if (!token.empty()) {
+        prerequisites.emplace_back(token);
+    }
 
-    while (getline(cache, line)) {
-#if defined(_WIN32)
-        errno = 0;
-        if (_putenv(line.c_str()) != 0) {
-#else
-        const size_t j{ line.find('=') };
-        const std::string key{ line.substr(0, j - 1) };
-        const std::string value{ line.substr(j + 1, line.size()) };
+    return prerequisites;
+}
 
-        errno = 0;
-        if (setenv(key.c_str(), value.c_str(), 1) != 0) {
-#endif
-            cache.close();
+std::vector<std::filesystem::path> ParseSourceDependencies(const std::string &contents) {
+    std::vector<std::filesystem::path> includes;
+    const std::size_t key{ contents.find(R"("Includes")") };
 
-            std::stringstream err;
-            err << "error applying environment variable key=value pair: "
-                << line
-                << " errno: "
-                << errno;
-            throw std::runtime_error{ err.str() };
+    if (key == std::string::npos) {
+        return includes;
+    }
+
+    std::size_t i{ contents.find('[', key) };
+
+    if (i == std::string::npos) {
+        return includes;
+    }
+
+    for (i++; i < contents.size() && contents[i] != ']'; i++) {
+        if (contents[i] != '"') {
+            continue;
+        }
+
+        std::string include;
+
+        for (i++; i < contents.size() && contents[i] != '"'; i++) {
+            if (contents[i] == '\\' && i + 1 < contents.size()) {
+                i++;
+            }
+
+            include += contents[i];
         }
+
+        includes.emplace_back(include);
     }
 
-    cache.close();
+    return includes;
 }
 
-void Config::Load() {
-    windows = DetectWindowsEnvironment();
+/**
+ * @brief ProbeOutput runs a compiler probe command, collecting its output.
+ *
+ * @param argv the probe command
+ * @returns the captured standard output and standard error; or an empty string when the probe cannot launch
+ */
+static std::string ProbeOutput(const std::vector<std::string> &argv) {
+    try {
+        Process process(argv, RunOptions{ true, true });
+        process.Wait();
+        return process.Stdout() + process.Stderr();
+    } catch (const std::runtime_error &) {
+        return "";
+    }
+}
 
-    if (!std::filesystem::exists(TaskDefinitionCpp)) {
-        if (std::filesystem::exists(TaskDefinitionC)) {
-            task_definition_path = TaskDefinitionC;
-            task_definition_lang = Lang::C;
-        } else {
-            throw std::runtime_error("error locating a task definition file rez.{cpp,c}");
-        }
+/**
+ * @brief FirstLine extracts the first line of text, sanitized for use as a fingerprint field.
+ *
+ * @param text some text
+ * @returns the first line, without carriage returns and with tabs replaced by spaces
+ */
+static std::string FirstLine(const std::string &text) {
+    std::string line{ text.substr(0, text.find('\n')) };
+    line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+    std::replace(line.begin(), line.end(), '\t', ' ');
+    return line;
+}
+
+/**
+ * @brief ProbeCompiler queries a compiler's version, target, and default language standard.
+ *
+ * @param compiler_argv a compiler command, split per @ref SplitArguments
+ * @param lang the task definition language
+ * @param msvc whether the compiler is cl
+ * @returns version, target, and standard fields
+ */
+static std::vector<std::string> ProbeCompiler(const std::vector<std::string> &compiler_argv, Lang lang, bool msvc) {
+    if (msvc) {
+        // cl reports its version and target architecture in a banner, e.g. "... Version 19.38.33134 for x64".
+        const std::string banner{ FirstLine(ProbeOutput(compiler_argv)) };
+        const size_t j{ banner.rfind(" for ") };
+        return { banner, j == std::string::npos ? "" : banner.substr(j + 5), "" };
     }
 
-    if (windows) {
-        compiler = DefaultCompilerWindows;
-    } else if (task_definition_lang == Lang::C) {
-        compiler = DefaultCompilerUnixC;
+    std::vector<std::string> version_argv{ compiler_argv };
+    version_argv.emplace_back("--version");
+
+    std::vector<std::string> target_argv{ compiler_argv };
+    target_argv.emplace_back("-dumpmachine");
+
+    std::vector<std::string> macros_argv{ compiler_argv };
+    macros_argv.insert(macros_argv.end(), { "-x", lang == Lang::Cpp ? "c++" : "c", "-dM", "-E", "/dev/null" });
+
+    const std::string standard_macro{ lang == Lang::Cpp ? "#define __cplusplus " : "#define __STDC_VERSION__ " };
+    const std::string macros{ ProbeOutput(macros_argv) };
+    const size_t i{ macros.find(standard_macro) };
+    const std::string standard{ i == std::string::npos ? "" : FirstLine(macros.substr(i + standard_macro.size())) };
+
+    return { FirstLine(ProbeOutput(version_argv)), FirstLine(ProbeOutput(target_argv)), standard };
+}
+
+/**
+ * @brief ProbeLinker determines whether a compiler driver accepts a linker selection flag.
+ *
+ * @param compiler_argv a compiler command, split per @ref SplitArguments
+ * @param linker_flag a flag such as -fuse-ld=mold
+ * @returns true when the driver locates and runs the linker
+ */
+static bool ProbeLinker(const std::vector<std::string> &compiler_argv, const std::string &linker_flag) {
+    std::vector<std::string> argv{ compiler_argv };
+    argv.insert(argv.end(), { linker_flag, "-Wl,--version" });
+
+    try {
+        Process process(argv, RunOptions{ true, true });
+        return process.Wait() == EXIT_SUCCESS;
+    } catch (const std::runtime_error &) {
+        return false;
     }
+}
 
-    if (task_definition_lang == Lang::Cpp) {
-        const std::optional<std::string> compiler_override{ GetEnvironmentVariable("CXX"s) };
+/**
+ * @brief DefinesBeforeIncludes detects task definitions which configure headers (e.g. feature test macros) before their first include.
+ *
+ * A precompiled prelude would be included ahead of such definitions, changing their meaning.
+ *
+ * @param path a source file
+ * @returns true when a #define directive precedes the first #include directive
+ */
+static bool DefinesBeforeIncludes(const std::filesystem::path &path) {
+    std::ifstream f(path);
+    std::string line;
 
-        if (compiler_override.has_value()) {
-            const std::string &compiler_override_s = *compiler_override;
+    while (getline(f, line)) {
+        const std::size_t i{ line.find_first_not_of(" \t") };
 
-            if (!compiler_override_s.empty()) {
-                compiler = compiler_override_s;
-            }
+        if (i == std::string::npos || line[i] != '#') {
+            continue;
         }
-    } else {
-        const std::optional<std::string> compiler_override{ GetEnvironmentVariable("CC"s) };
 
-        if (compiler_override.has_value()) {
-            const std::string &compiler_override_s = *compiler_override;
+        const std::size_t j{ line.find_first_not_of(" \t", i + 1) };
 
-            if (!compiler_override_s.empty()) {
-                compiler = compiler_override_s;
-            }
+        if (j == std::string::npos) {
+            continue;
+        }
+
+        if (line.compare(j, 7, "include") == 0) {
+            return false;
+        }
+
+        if (line.compare(j, 6, "define") == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief IncludesHeader detects source files which include a header directly.
+ *
+ * @param path a source file
+ * @param header an include path, such as rez/rez.hpp
+ * @returns true when an #include directive names header, in angle brackets or quotes
+ */
+static bool IncludesHeader(const std::filesystem::path &path, const std::string &header) {
+    std::ifstream f(path);
+    std::string line;
+
+    while (getline(f, line)) {
+        line.erase(std::remove_if(line.begin(), line.end(), [](char c) { return c == ' ' || c == '\t' || c == '\r'; }), line.end());
+
+        if (line == "#include<" + header + ">" || line == "#include\"" + header + "\"") {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief ImportsModule detects task definitions which import the rez C++20 module.
+ *
+ * @param path a source file
+ * @returns true when a line declares import rez;
+ */
+static bool ImportsModule(const std::filesystem::path &path) {
+    std::ifstream f(path);
+    std::string line;
+
+    while (getline(f, line)) {
+        line.erase(std::remove_if(line.begin(), line.end(), [](char c) { return c == ' ' || c == '\t' || c == '\r'; }), line.end());
+
+        if (line == "importrez;" || line == "exportimportrez;") {
+            return true;
         }
     }
 
+    return false;
+}
+
+/**
+ * @brief ModuleFlavor denotes the C++20 module command line conventions of a compiler.
+ */
+enum class ModuleFlavor {
+    /**
+     * @brief GCC denotes -fmodules-ts with a module mapper file.
+     */
+    GCC,
+
+    /**
+     * @brief Clang denotes -fmodule-output and -fmodule-file.
+     */
+    Clang,
+
+    /**
+     * @brief MSVC denotes cl /interface, /ifcOutput, and /reference.
+     */
+    MSVC
+};
+
+/**
+ * @brief DetectModuleFlavor classifies a compiler by its module conventions.
+ *
+ * @param compiler a compiler command
+ * @param fingerprint the compiler fingerprint, which includes the version banner
+ * @returns a flavor
+ */
+static ModuleFlavor DetectModuleFlavor(const std::string &compiler, const std::string &fingerprint) {
     if (compiler == DefaultCompilerWindows) {
-        ApplyMSVCToolchain();
+        return ModuleFlavor::MSVC;
     }
 
-    artifact_file_path = ApplyBinaryExtension(
-        artifact_dir_path / ArtifactFileBasenameUnix,
-        windows);
+    return fingerprint.find("clang") != std::string::npos ? ModuleFlavor::Clang : ModuleFlavor::GCC;
+}
 
-    std::stringstream ss;
-    ss << compiler;
-    ss << " ";
+/**
+ * @brief CompiledModulePath denotes the compiled module interface (BMI) file for a flavor.
+ *
+ * @param flavor a module flavor
+ * @param module_dir_path a module directory
+ * @returns a path inside of module_dir_path
+ */
+static std::filesystem::path CompiledModulePath(ModuleFlavor flavor, const std::filesystem::path &module_dir_path) {
+    switch (flavor) {
+    case ModuleFlavor::Clang:
+        return module_dir_path / "rez.pcm";
+    case ModuleFlavor::MSVC:
+        return module_dir_path / "rez.ifc";
+    default:
+        return module_dir_path / "rez.gcm";
+    }
+}
 
-    const std::optional<std::string> flags_cpp_opt{ rez::GetEnvironmentVariable("CPPFLAGS") };
-    std::string flags_cpp;
+/**
+ * @brief ModuleObjectPath denotes the object file emitted alongside the compiled module interface.
+ *
+ * @param flavor a module flavor
+ * @param module_dir_path a module directory
+ * @returns a path inside of module_dir_path
+ */
+static std::filesystem::path ModuleObjectPath(ModuleFlavor flavor, const std::filesystem::path &module_dir_path) {
+    return module_dir_path / (flavor == ModuleFlavor::MSVC ? "rez.obj" : "rez.o");
+}
 
-    if (flags_cpp_opt.has_value()) {
-        const std::string &flags = *flags_cpp_opt;
+/**
+ * @brief TaskDefinitionDirSources lists the source files directly inside of TaskDefinitionDir.
+ *
+ * @param extension a file extension, such as ".cpp"
+ * @returns matching paths, in lexicographic order
+ */
+static std::vector<std::filesystem::path> TaskDefinitionDirSources(const std::string &extension) {
+    std::vector<std::filesystem::path> sources;
+    std::error_code ec;
 
-        if (!flags.empty()) {
-            flags_cpp = flags;
+    for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(TaskDefinitionDir, ec)) {
+        if (entry.is_regular_file(ec) && entry.path().extension() == extension) {
+            sources.push_back(entry.path());
         }
     }
 
-    std::string flags_cxx, flags_c;
+    std::sort(sources.begin(), sources.end());
+    return sources;
+}
 
-    if (task_definition_lang == Lang::Cpp) {
-        const std::optional<std::string> flags_cxx_opt{ rez::GetEnvironmentVariable("CXXFLAGS") };
+/**
+ * @brief HexDigest formats a digest as a cache key.
+ *
+ * @param h a digest
+ * @returns 16 hexadecimal digits
+ */
+static std::string HexDigest(std::uint64_t h) {
+    std::stringstream ss;
+    ss << std::hex << std::setfill('0') << std::setw(16) << h;
+    return ss.str();
+}
 
-        if (flags_cxx_opt.has_value()) {
-            const std::string &flags = *flags_cxx_opt;
+/**
+ * @brief HashDependencies digests the paths and contents of dependencies.
+ *
+ * @param dependencies headers recorded by a prior compilation
+ * @param seed a starting value
+ * @returns a digest
+ */
+static std::uint64_t HashDependencies(const std::vector<std::filesystem::path> &dependencies, std::uint64_t seed) {
+    std::uint64_t h{ seed };
+
+    for (const std::filesystem::path &dependency : dependencies) {
+        const std::string dependency_s{ dependency.string() };
+        h = HashBytes(dependency_s.data(), dependency_s.size(), h);
+
+        try {
+            h = HashFile(dependency, h);
+        } catch (const std::runtime_error &) {
+            // A vanished header must invalidate the build.
+            h = HashBytes("\0", 1, h);
+        }
+    }
+
+    return h;
+}
+
+/**
+ * @brief HashBuildInputs digests the inputs of one compilation step.
+ *
+ * @param source_path a source file
+ * @param compiler the compiler
+ * @param argv the compilation step
+ * @param dependencies headers recorded by the prior compilation
+ * @param identity the compiler fingerprint, per @ref Config::FingerprintCompiler
+ * @returns a digest
+ *
+ * @throws an error in the event of a problem
+ */
+static std::uint64_t HashBuildInputs(const std::filesystem::path &source_path, const std::string &compiler, const std::vector<std::string> &argv, const std::vector<std::filesystem::path> &dependencies, const std::string &identity) {
+    std::uint64_t h{ HashFile(source_path, 0) };
+    h = HashBytes(compiler.data(), compiler.size(), h);
+
+    for (const std::string &arg : argv) {
+        h = HashBytes(arg.data(), arg.size() + 1, h);
+    }
+
+    h = HashDependencies(dependencies, h);
 
-            if (!flags.empty()) {
-                flags_cxx = flags;
+    // Identify the compiler binary itself, so that toolchain upgrades invalidate the build.
+    return HashBytes(identity.data(), identity.size(), h);
+}
+
+/**
+ * @brief Concatenate joins two collections of dependencies.
+ *
+ * @param a some dependencies
+ * @param b more dependencies
+ * @returns a followed by b
+ */
+static std::vector<std::filesystem::path> Concatenate(std::vector<std::filesystem::path> a, const std::vector<std::filesystem::path> &b) {
+    a.insert(a.end(), b.begin(), b.end());
+    return a;
+}
+
+/**
+ * @brief EditedDuringBuild detects edits made to the inputs of a compilation while it ran.
+ *
+ * @param inputs the files read by the compilation, listed before it started
+ * @param digest the digest of inputs, per @ref HashDependencies, before the compilation started
+ * @param built_inputs the files read by the compilation, as recorded by the compilation itself
+ * @param since the time at which the compilation started
+ * @returns true when inputs no longer match digest, or when any file first recorded in built_inputs was modified since
+ */
+static bool EditedDuringBuild(const std::vector<std::filesystem::path> &inputs, std::uint64_t digest, const std::vector<std::filesystem::path> &built_inputs, const std::filesystem::file_time_type &since) {
+    if (HashDependencies(inputs, 0) != digest) {
+        return true;
+    }
+
+    // Headers first seen by this compilation were not digested beforehand. Judge them by modification time.
+    const std::set<std::filesystem::path> known(inputs.begin(), inputs.end());
+
+    return std::any_of(built_inputs.begin(), built_inputs.end(), [&known, &since](const std::filesystem::path &input) {
+        std::error_code ec;
+        return known.find(input) == known.end() && std::filesystem::last_write_time(input, ec) >= since && !ec;
+    });
+}
+
+std::vector<std::string> SplitArguments(const std::string &s) {
+    std::vector<std::string> args;
+    std::string arg;
+    bool in_arg{ false };
+    char quote{ 0 };
+
+    for (std::size_t i{ 0 }; i < s.size(); i++) {
+        const char c{ s[i] };
+
+        if (quote != 0) {
+            if (c == quote) {
+                quote = 0;
+            } else if (c == '\\' && quote == '"' && i + 1 < s.size() && (s[i + 1] == '"' || s[i + 1] == '\\')) {
+                arg += s[++i];
+            } else {
+                arg += c;
             }
+
+            continue;
         }
-    } else {
-        const std::optional<std::string> flags_c_opt{ rez::GetEnvironmentVariable("CFLAGS") };
 
-        if (flags_c_opt.has_value()) {
-            const std::string &flags = *flags_c_opt;
+        if (c == '"' || c == '\'') {
+            quote = c;
+            in_arg = true;
+            continue;
+        }
 
-            if (!flags.empty()) {
-                flags_c = flags;
+        if (isspace(static_cast<unsigned char>(c)) != 0) {
+            if (in_arg) {
+                args.push_back(arg);
+                arg.clear();
+                in_arg = false;
             }
+
+            continue;
         }
+
+        // Backslashes are literal outside of quotes, preserving Windows paths.
+        arg += c;
+        in_arg = true;
     }
 
-    const std::string artifact_file_path_s{ artifact_file_path.string() };
+    if (in_arg) {
+        args.push_back(arg);
+    }
 
-    if (compiler == DefaultCompilerWindows) {
-        if (!flags_cpp.empty()) {
-            ss << flags_cpp;
-            ss << " ";
-        }
+    return args;
+}
 
-        if (task_definition_lang == Lang::Cpp && !flags_cxx.empty()) {
-            ss << flags_cxx;
-            ss << " ";
-        } else if (task_definition_lang == Lang::C && !flags_c.empty()) {
-            ss << flags_c;
+std::string JoinArguments(const std::vector<std::string> &argv) {
+    std::stringstream ss;
+
+    for (std::size_t i{ 0 }; i < argv.size(); i++) {
+        if (i != 0) {
             ss << " ";
         }
 
-        ss << task_definition_path;
-        ss << " /link /out:";
-        ss << artifact_file_path_s;
-    } else {
-        ss << "-o ";
-        ss << artifact_file_path_s;
-        ss << " ";
+        const std::string &arg = argv[i];
 
-        if (!flags_cpp.empty()) {
-            ss << flags_cpp;
-            ss << " ";
+        if (arg.empty() || arg.find_first_of(" \t\"'") != std::string::npos) {
+            ss << std::quoted(arg);
+        } else {
+            ss << arg;
         }
+    }
 
-        if (task_definition_lang == Lang::Cpp && !flags_cxx.empty()) {
-            ss << flags_cxx;
-            ss << " ";
-        } else if (task_definition_lang == Lang::C && !flags_c.empty()) {
-            ss << flags_c;
-            ss << " ";
-        }
+    return ss.str();
+}
+
+int Spawn(const std::vector<std::string> &argv) {
+    return Process(argv).Wait();
+}
+
+int Exec(const std::vector<std::string> &argv) {
+    if (argv.empty()) {
+        throw std::runtime_error("error executing process: empty argv");
+    }
 
-        ss << task_definition_path;
+#if defined(_WIN32)
+    // Windows lacks a true exec; _execvp would return control to the parent console prematurely.
+    return Spawn(argv);
+#else
+    std::vector<char *> c_argv;
+
+    for (const std::string &arg : argv) {
+        c_argv.push_back(const_cast<char *>(arg.c_str()));
     }
 
-    build_command = ss.str();
+    c_argv.push_back(nullptr);
+
+    std::cout.flush();
+    execvp(argv.front().c_str(), c_argv.data());
+    throw std::runtime_error("error executing process: "s + argv.front() + " errno: " + std::to_string(errno));
+#endif
 }
 
-std::ostream &operator<<(std::ostream &os, const Config &o) {
-    return os << "{ cache_file_path: " << o.cache_file_path
-              << ", debug: " << o.debug
+void ExportEnvironmentVariable(const std::string &key, const std::string &value) {
+    errno = 0;
+#if defined(_WIN32)
+    if (_putenv_s(key.c_str(), value.c_str()) != 0) {
+#else
+    if (setenv(key.c_str(), value.c_str(), 1) != 0) {
+#endif
+        throw std::runtime_error("error setting environment variable: "s + key + " errno: " + std::to_string(errno));
+    }
+}
+
+void StartJobserver(std::size_t jobs) {
+#if defined(_WIN32)
+    (void) jobs;
+#else
+    const std::string makeflags{ GetEnvironmentVariable("MAKEFLAGS").value_or("") };
+
+    if (makeflags.find("--jobserver-auth=") != std::string::npos || makeflags.find("--jobserver-fds=") != std::string::npos) {
+        return;
+    }
+
+    int fds[2]{ -1, -1 };
+
+    if (pipe(fds) != 0) {
+        throw std::runtime_error("error creating jobserver pipe errno: "s + std::to_string(errno));
+    }
+
+    // The implicit slot belongs to the delegate itself.
+    const std::string tokens(jobs - 1, '+');
+    std::size_t written{ 0 };
+
+    while (written < tokens.size()) {
+        const ssize_t n{ write(fds[1], tokens.data() + written, tokens.size() - written) };
+
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            throw std::runtime_error("error filling jobserver pipe errno: "s + std::to_string(errno));
+        }
+
+        written += static_cast<std::size_t>(n);
+    }
+
+    std::stringstream ss;
+    ss << "-j" << jobs << " --jobserver-auth=" << fds[0] << "," << fds[1];
+
+    if (!makeflags.empty()) {
+        ss << " " << makeflags;
+    }
+
+    ExportEnvironmentVariable("MAKEFLAGS", ss.str());
+#endif
+}
+
+bool DetectWindowsEnvironment() {
+    return GetEnvironmentVariable("COMSPEC").has_value();
+}
+
+/**
+ * @brief EnvironmentCacheMagic prefixes binary toolchain environment caches.
+ */
+static constexpr char EnvironmentCacheMagic[8]{ 'R', 'E', 'Z', 'E', 'N', 'V', '0', '1' };
+
+/**
+ * @brief VolatileEnvironmentVariables lists variables which rez itself, or the shell, varies between otherwise identical runs.
+ */
+static const std::set<std::string> VolatileEnvironmentVariables{ "MAKEFLAGS", "MFLAGS", "OLDPWD", "REZ_JOBS", "REZ_TRACE_FILE", "SHLVL", "_" };
+
+/**
+ * @brief EnvironmentKey digests a toolchain query, plus the calling environment.
+ *
+ * @param seed identifies the query
+ * @returns a digest
+ */
+static std::uint64_t EnvironmentKey(const std::string &seed) {
+    std::vector<std::string> pairs;
+
+#if defined(_WIN32)
+    char **env{ _environ };
+#else
+    char **env{ environ };
+#endif
+
+    for (; env != nullptr && *env != nullptr; env++) {
+        const std::string pair{ *env };
+
+        if (VolatileEnvironmentVariables.count(pair.substr(0, pair.find('='))) == 0) {
+            pairs.push_back(pair);
+        }
+    }
+
+    std::sort(pairs.begin(), pairs.end());
+    std::uint64_t h{ HashBytes(seed.data(), seed.size() + 1, 0) };
+
+    for (const std::string &pair : pairs) {
+        h = HashBytes(pair.data(), pair.size() + 1, h);
+    }
+
+    return h;
+}
+
+/**
+ * @brief ParseEnvironment collects the variables of a `set` or `env` listing which differ from the current process.
+ *
+ * Lines without a KEY= prefix continue the prior value, as for multiline values.
+ *
+ * @param listing KEY=VALUE lines
+ * @returns changed KEY, VALUE pairs
+ */
+static std::vector<std::pair<std::string, std::string>> ParseEnvironment(const std::string &listing) {
+    std::vector<std::pair<std::string, std::string>> pairs;
+    std::stringstream ss(listing);
+    std::string line;
+
+    while (getline(ss, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        const size_t j{ line.find('=') };
+        const bool assignment{ j != std::string::npos && j > 0 && std::all_of(line.begin(), line.begin() + static_cast<std::ptrdiff_t>(j), [](unsigned char c) { return isalnum(c) || c == '_' || c == '(' || c == ')'; }) };
+
+        if (assignment) {
+            pairs.emplace_back(line.substr(0, j), line.substr(j + 1));
+        } else if (!pairs.empty()) {
+            pairs.back().second += "\n" + line;
+        }
+    }
+
+    pairs.erase(
+        std::remove_if(pairs.begin(), pairs.end(), [](const std::pair<std::string, std::string> &pair) {
+            if (VolatileEnvironmentVariables.count(pair.first) != 0) {
+                return true;
+            }
+
+            const std::optional<std::string> current{ GetEnvironmentVariable(pair.first) };
+            return current.has_value() && *current == pair.second;
+        }),
+        pairs.end());
+    return pairs;
+}
+
+/**
+ * @brief ApplyEnvironment exports KEY, VALUE pairs into the current process.
+ *
+ * @param pairs KEY, VALUE pairs
+ *
+ * @throws an error in the event of a problem
+ */
+static void ApplyEnvironment(const std::vector<std::pair<std::string, std::string>> &pairs) {
+    for (const auto &[key, value] : pairs) {
+        ExportEnvironmentVariable(key, value);
+    }
+}
+
+/**
+ * @brief ReplayEnvironment applies a binary toolchain environment cache, when its key matches.
+ *
+ * The whole cache is read at once.
+ *
+ * @param path a cache file path
+ * @param key the expected @ref EnvironmentKey
+ * @returns true when the cache applied
+ *
+ * @throws an error in the event of a problem
+ */
+static bool ReplayEnvironment(const std::filesystem::path &path, std::uint64_t key) {
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+
+    if (!f) {
+        return false;
+    }
+
+    const std::streamsize size{ f.tellg() };
+
+    if (size < static_cast<std::streamsize>(sizeof(EnvironmentCacheMagic) + sizeof(key))) {
+        return false;
+    }
+
+    std::string buf(static_cast<size_t>(size), '\0');
+    f.seekg(0);
+
+    if (!f.read(buf.data(), size) || memcmp(buf.data(), EnvironmentCacheMagic, sizeof(EnvironmentCacheMagic)) != 0) {
+        return false;
+    }
+
+    std::uint64_t recorded_key{ 0 };
+    memcpy(&recorded_key, buf.data() + sizeof(EnvironmentCacheMagic), sizeof(recorded_key));
+
+    if (recorded_key != key) {
+        return false;
+    }
+
+    // Records are NUL terminated KEY, VALUE strings.
+    std::vector<std::pair<std::string, std::string>> pairs;
+    size_t i{ sizeof(EnvironmentCacheMagic) + sizeof(key) };
+
+    while (i < buf.size()) {
+        const size_t key_end{ buf.find('\0', i) };
+        const size_t value_end{ key_end == std::string::npos ? std::string::npos : buf.find('\0', key_end + 1) };
+
+        if (value_end == std::string::npos) {
+            return false;
+        }
+
+        pairs.emplace_back(buf.substr(i, key_end - i), buf.substr(key_end + 1, value_end - key_end - 1));
+        i = value_end + 1;
+    }
+
+    ApplyEnvironment(pairs);
+    return true;
+}
+
+/**
+ * @brief SaveEnvironment writes a binary toolchain environment cache, via a temporary file and rename.
+ *
+ * @param path a cache file path
+ * @param key the @ref EnvironmentKey
+ * @param pairs KEY, VALUE pairs
+ *
+ * @throws an error in the event of a problem
+ */
+static void SaveEnvironment(const std::filesystem::path &path, std::uint64_t key, const std::vector<std::pair<std::string, std::string>> &pairs) {
+    std::string buf(EnvironmentCacheMagic, sizeof(EnvironmentCacheMagic));
+    buf.append(reinterpret_cast<const char *>(&key), sizeof(key));
+
+    for (const auto &[k, v] : pairs) {
+        buf += k;
+        buf += '\0';
+        buf += v;
+        buf += '\0';
+    }
+
+    std::filesystem::create_directories(path.parent_path());
+    std::filesystem::path temp_path{ path };
+    temp_path += ".tmp";
+
+    {
+        std::ofstream f(temp_path, std::ios::binary | std::ios::trunc);
+
+        if (!f.write(buf.data(), static_cast<std::streamsize>(buf.size()))) {
+            throw std::runtime_error("error writing toolchain environment cache: "s + temp_path.string());
+        }
+    }
+
+    std::filesystem::rename(temp_path, path);
+}
+
+void Config::ApplyMSVCToolchain() const {
+    const Span span("toolchain", "rez");
+
+    std::string query_path(DefaultMSVCToolchainQueryScript);
+    const std::optional<std::string> query_path_override{ GetEnvironmentVariable("REZ_TOOLCHAIN_QUERY_PATH") };
+
+    if (query_path_override.has_value()) {
+        query_path = *query_path_override;
+    }
+
+    std::string arch(ArchitectureMsvcAmd64);
+    const std::optional<std::string> arch_override{ GetEnvironmentVariable("REZ_ARCH") };
+
+    if (arch_override.has_value()) {
+        arch = *arch_override;
+    }
+
+    const std::uint64_t key{ EnvironmentKey("msvc\n"s + query_path + "\n" + arch) };
+
+    if (ReplayEnvironment(cache_file_path, key)) {
+        return;
+    }
+
+    // Let one rez process query the toolchain, while any others wait to replay its capture.
+    const FileLock lock(std::filesystem::path(CacheDir) / LockFileBasename);
+
+    if (ReplayEnvironment(cache_file_path, key)) {
+        return;
+    }
+
+    if (debug) {
+        std::cerr << "querying msvc toolchain...\n";
+    }
+
+    std::stringstream ss;
+    ss << R"(cmd.exe /c "")";
+    ss << query_path;
+    ss << R"(" )";
+    ss << arch;
+    ss << R"( && set")";
+    const std::string query_command{ ss.str() };
+
+    if (debug) {
+        std::cerr << "running msvc query command: " << query_command << "\n";
+    }
+
+    errno = 0;
+    FILE *process{ popen(query_command.c_str(), "r") };
+
+    if (process == nullptr) {
+        throw std::runtime_error{ "error launching msvc query command: "s + query_command };
+    }
+
+    // https://devblogs.microsoft.com/oldnewthing/20100203-00/?p=15083#:~:text=The%20theoretical%20maximum%20length%20of,a%20limit%20of%2032767%20characters.
+    char line[32760]{ 0 };
+    std::string listing;
+
+    while (fgets(line, sizeof(line), process) != nullptr) {
+        listing += line;
+    }
+
+    const int query_status{ pclose(process) };
+
+    if (query_status != EXIT_SUCCESS) {
+        std::stringstream err;
+        err << "error running query command: "
+            << query_command
+            << " status: " << query_status;
+        throw std::runtime_error{ err.str() };
+    }
+
+    const std::vector<std::pair<std::string, std::string>> pairs{ ParseEnvironment(listing) };
+    SaveEnvironment(cache_file_path, key, pairs);
+    ApplyEnvironment(pairs);
+}
+
+void Config::ApplyToolchainScript(const std::filesystem::path &script_path) const {
+    const Span span("toolchain", "rez");
+    const std::filesystem::path script_absolute_path{ std::filesystem::absolute(script_path) };
+    const std::string script_absolute_path_s{ script_absolute_path.string() };
+    std::uint64_t script_hash{ 0 };
+
+    try {
+        script_hash = HashFile(script_absolute_path, 0);
+    } catch (const std::runtime_error &) {
+        throw std::runtime_error("error reading toolchain query script: "s + script_absolute_path_s);
+    }
+
+    const std::uint64_t key{ EnvironmentKey("sh\n"s + script_absolute_path_s + "\n" + std::to_string(script_hash)) };
+
+    if (ReplayEnvironment(cache_file_path, key)) {
+        return;
+    }
+
+    const FileLock lock(std::filesystem::path(CacheDir) / LockFileBasename);
+
+    if (ReplayEnvironment(cache_file_path, key)) {
+        return;
+    }
+
+    // Setup scripts may chatter on stdout, so route it to stderr, away from the listing.
+    const std::vector<std::string> query_argv{ "/bin/sh", "-c", ". \"$0\" 1>&2 && env", script_absolute_path_s };
+
+    if (debug) {
+        std::cerr << "running toolchain query command: " << JoinArguments(query_argv) << "\n";
+    }
+
+    Process process(query_argv, RunOptions{ true, false });
+    const int query_status{ process.Wait() };
+
+    if (query_status != EXIT_SUCCESS) {
+        throw std::runtime_error("error running query command: "s + JoinArguments(query_argv) + " status: " + std::to_string(query_status));
+    }
+
+    const std::vector<std::pair<std::string, std::string>> pairs{ ParseEnvironment(process.Stdout()) };
+    SaveEnvironment(cache_file_path, key, pairs);
+    ApplyEnvironment(pairs);
+}
+
+/**
+ * @brief OptimizationFlag determines whether a compiler flag selects optimization or link time optimization.
+ *
+ * @param flag a compiler flag
+ * @param msvc whether the flag targets cl, which also accepts / options
+ * @returns true for flags such as -O3, -Ofast, -flto=auto, /O2, and /GL
+ */
+static bool OptimizationFlag(const std::string &flag, bool msvc) {
+    if (msvc) {
+        return ((flag[0] == '/' || flag[0] == '-') && flag.compare(1, 1, "O") == 0 && flag.size() > 2) || flag == "/GL" || flag == "-GL";
+    }
+
+    // Match whole tokens, sparing flags such as -ObjC, and paths.
+    static const std::set<std::string> levels{ "-O", "-O0", "-O1", "-O2", "-O3", "-O4", "-Os", "-Oz", "-Og", "-Ofast", "-fwhole-program", "-flto" };
+    return levels.find(flag) != levels.end() || flag.rfind("-flto=", 0) == 0;
+}
+
+void Config::Load() {
+    windows = DetectWindowsEnvironment();
+
+    // Setup scripts commonly choose CC, CXX, and flags, so apply them first.
+    if (!windows) {
+        const std::optional<std::string> toolchain_script{ GetEnvironmentVariable("REZ_TOOLCHAIN_QUERY_PATH") };
+
+        if (toolchain_script.has_value() && !toolchain_script->empty()) {
+            ApplyToolchainScript(*toolchain_script);
+        }
+    }
+
+    std::vector<std::filesystem::path> dir_sources;
+
+    if (!std::filesystem::exists(TaskDefinitionCpp)) {
+        if (std::filesystem::exists(TaskDefinitionC)) {
+            task_definition_path = TaskDefinitionC;
+            task_definition_lang = Lang::C;
+        } else {
+            task_definition_path = TaskDefinitionDir;
+            dir_sources = TaskDefinitionDirSources(".cpp");
+
+            if (dir_sources.empty()) {
+                task_definition_lang = Lang::C;
+                dir_sources = TaskDefinitionDirSources(".c");
+            }
+
+            if (dir_sources.empty()) {
+                throw std::runtime_error("error locating a task definition file rez.{cpp,c}, or directory rez");
+            }
+        }
+    }
+
+    if (windows) {
+        compiler = DefaultCompilerWindows;
+    } else if (task_definition_lang == Lang::C) {
+        compiler = DefaultCompilerUnixC;
+    }
+
+    bool compiler_overridden{ false };
+
+    if (task_definition_lang == Lang::Cpp) {
+        const std::optional<std::string> compiler_override{ GetEnvironmentVariable("CXX"s) };
+
+        if (compiler_override.has_value()) {
+            const std::string &compiler_override_s = *compiler_override;
+
+            if (!compiler_override_s.empty()) {
+                compiler = compiler_override_s;
+                compiler_overridden = true;
+            }
+        }
+    } else {
+        const std::optional<std::string> compiler_override{ GetEnvironmentVariable("CC"s) };
+
+        if (compiler_override.has_value()) {
+            const std::string &compiler_override_s = *compiler_override;
+
+            if (!compiler_override_s.empty()) {
+                compiler = compiler_override_s;
+                compiler_overridden = true;
+            }
+        }
+    }
+
+    const std::string compiler_selection{ GetEnvironmentVariable("REZ_COMPILER").value_or("") };
+
+    if (!compiler_selection.empty() && compiler_selection != "default" && compiler_selection != "fastest") {
+        throw std::runtime_error("error: unsupported REZ_COMPILER: "s + compiler_selection + " (expected default or fastest)");
+    }
+
+    if (compiler == DefaultCompilerWindows) {
+        ApplyMSVCToolchain();
+    }
+
+    profile = GetEnvironmentVariable("REZ_PROFILE").value_or("");
+
+    if (profile.empty()) {
+        profile = DefaultProfile;
+    }
+
+    if (profile != "debug" && profile != "release") {
+        throw std::runtime_error("error: unsupported REZ_PROFILE: "s + profile + " (expected debug or release)");
+    }
+
+    // Profiles build side by side, so that switching between them reuses each cached delegate.
+    artifact_dir_path = std::filesystem::path(CacheDir) / ArtifactDirBasename / profile;
+    manifest_path = artifact_dir_path / ManifestFileBasename;
+    depfile_path = artifact_dir_path / (compiler == DefaultCompilerWindows ? DepfileBasenameMSVC : DepfileBasenameUnix);
+    translation_units.clear();
+
+    for (const std::filesystem::path &source_path : dir_sources) {
+        const std::filesystem::path stem{ std::filesystem::path(CacheDir) / ObjectDirBasename / profile / source_path.filename() };
+        TranslationUnit translation_unit;
+        translation_unit.source_path = source_path;
+        translation_unit.object_path = stem;
+        translation_unit.object_path += compiler == DefaultCompilerWindows ? ".obj" : ".o";
+        translation_unit.depfile_path = stem;
+        translation_unit.depfile_path += compiler == DefaultCompilerWindows ? ".json" : ".d";
+        translation_unit.manifest_path = stem;
+        translation_unit.manifest_path += ".key";
+        translation_units.push_back(translation_unit);
+    }
+
+    const std::optional<std::string> delegate_mode_override{ GetEnvironmentVariable("REZ_DELEGATE_MODE") };
+
+    if (delegate_mode_override.has_value() && *delegate_mode_override == "shared") {
+        if (compiler == DefaultCompilerWindows) {
+            throw std::runtime_error("error: shared delegate mode is unsupported for cl");
+        }
+
+        delegate_mode = DelegateMode::SharedObject;
+    }
+
+    if (delegate_mode == DelegateMode::SharedObject) {
+        artifact_file_path = ApplySharedLibraryExtension(
+            artifact_dir_path / ArtifactFileBasenameUnix,
+            windows);
+        artifact_temp_file_path = ApplySharedLibraryExtension(
+            artifact_dir_path / (ArtifactFileBasenameUnix + ".tmp"s),
+            windows);
+    } else {
+        artifact_file_path = ApplyBinaryExtension(
+            artifact_dir_path / ArtifactFileBasenameUnix,
+            windows);
+        artifact_temp_file_path = ApplyBinaryExtension(
+            artifact_dir_path / (ArtifactFileBasenameUnix + ".tmp"s),
+            windows);
+    }
+
+    const std::optional<std::string> flags_cpp_opt{ rez::GetEnvironmentVariable("CPPFLAGS") };
+    std::string flags_cpp;
+
+    if (flags_cpp_opt.has_value()) {
+        const std::string &flags_cpp_s = *flags_cpp_opt;
+
+        if (!flags_cpp_s.empty()) {
+            flags_cpp = flags_cpp_s;
+        }
+    }
+
+    std::string flags_cxx, flags_c;
+
+    if (task_definition_lang == Lang::Cpp) {
+        const std::optional<std::string> flags_cxx_opt{ rez::GetEnvironmentVariable("CXXFLAGS") };
+
+        if (flags_cxx_opt.has_value()) {
+            const std::string &flags_cxx_s = *flags_cxx_opt;
+
+            if (!flags_cxx_s.empty()) {
+                flags_cxx = flags_cxx_s;
+            }
+        }
+    } else {
+        const std::optional<std::string> flags_c_opt{ rez::GetEnvironmentVariable("CFLAGS") };
+
+        if (flags_c_opt.has_value()) {
+            const std::string &flags_c_s = *flags_c_opt;
+
+            if (!flags_c_s.empty()) {
+                flags_c = flags_c_s;
+            }
+        }
+    }
+
+    flags = SplitArguments(flags_cpp);
+    const bool msvc{ compiler == DefaultCompilerWindows };
+    const auto optimization_flag{ [msvc](const std::string &flag) { return !flag.empty() && OptimizationFlag(flag, msvc); } };
+
+    // Position independent code must also apply to the precompiled prelude, so treat it as an ordinary flag.
+    if (delegate_mode == DelegateMode::SharedObject) {
+        flags.insert(flags.begin(), "-fPIC");
+    }
+
+    std::vector<std::string> flags_lang{ SplitArguments(task_definition_lang == Lang::Cpp ? flags_cxx : flags_c) };
+
+    // Application flags such as -O3 -flto slow delegate builds for little benefit to tasks, wherever they appear.
+    if (profile == "debug") {
+        flags.erase(std::remove_if(flags.begin(), flags.end(), optimization_flag), flags.end());
+        flags_lang.erase(std::remove_if(flags_lang.begin(), flags_lang.end(), optimization_flag), flags_lang.end());
+        flags_lang.emplace_back(msvc ? "/Od" : "-O0");
+    }
+
+    flags.insert(flags.end(), flags_lang.begin(), flags_lang.end());
+
+    // Candidates are timed with the final flags, which they must accept.
+    if (compiler_selection == "fastest" && !compiler_overridden && !windows) {
+        SelectCompiler();
+    }
+
+    FingerprintCompiler();
+
+    const std::string api_header{ task_definition_lang == Lang::Cpp ? "rez/rez.hpp" : "rez/rez.h" };
+
+    if (translation_units.empty()) {
+        pch_api = IncludesHeader(task_definition_path, api_header);
+    } else {
+        pch_api = std::all_of(translation_units.begin(), translation_units.end(), [&api_header](const TranslationUnit &translation_unit) { return IncludesHeader(translation_unit.source_path, api_header); });
+    }
+
+    std::string pch_seed{ compiler + "\n" + compiler_fingerprint + "\n" + (pch_api ? "api" : "") };
+
+    for (const std::string &flag : flags) {
+        pch_seed += '\0';
+        pch_seed += flag;
+    }
+
+    std::stringstream pch_key;
+    pch_key << (task_definition_lang == Lang::Cpp ? "cpp-" : "c-")
+            << std::hex << std::setfill('0') << std::setw(16)
+            << HashBytes(pch_seed.data(), pch_seed.size(), 0);
+    pch_dir_path = std::filesystem::path(CacheDir) / PchDirBasename / pch_key.str();
+
+    const std::optional<std::string> pch_override{ GetEnvironmentVariable("REZ_PCH") };
+    pch = !(pch_override.has_value() && *pch_override == "0");
+
+    // A failed precompile stays disabled until the headers behind it change.
+    if (pch && std::filesystem::exists(pch_dir_path / PchDisabledBasename)) {
+        std::ifstream marker(pch_dir_path / PchDisabledBasename);
+        std::string recorded_key;
+        getline(marker, recorded_key);
+        pch = recorded_key != HexDigest(HashDependencies(PrecompiledHeaderDependencies(), 0));
+    }
+
+    if (translation_units.empty()) {
+        pch = pch && !DefinesBeforeIncludes(task_definition_path);
+    } else {
+        pch = pch && std::none_of(translation_units.begin(), translation_units.end(), [](const TranslationUnit &translation_unit) { return DefinesBeforeIncludes(translation_unit.source_path); });
+    }
+
+    if (translation_units.empty()) {
+        module = task_definition_lang == Lang::Cpp && ImportsModule(task_definition_path);
+    } else {
+        module = task_definition_lang == Lang::Cpp && std::any_of(translation_units.begin(), translation_units.end(), [](const TranslationUnit &translation_unit) { return ImportsModule(translation_unit.source_path); });
+    }
+
+    module_dir_path = std::filesystem::path(CacheDir) / ModuleDirBasename / pch_key.str();
+
+    // The module replaces the prelude, which would otherwise redeclare the rez API textually.
+    if (module) {
+        pch = false;
+    }
+
+    const std::string shared_cache{ GetEnvironmentVariable("REZ_SHARED_CACHE").value_or("") };
+    shared_cache_dir_path.clear();
+
+    if (module) {
+        // Shared entries do not carry the compiled module.
+    } else if (translation_units.empty() && shared_cache == "1") {
+        const std::optional<std::string> xdg_cache_home{ GetEnvironmentVariable("XDG_CACHE_HOME") };
+        const std::optional<std::string> local_app_data{ GetEnvironmentVariable("LOCALAPPDATA") };
+        const std::optional<std::string> home{ GetEnvironmentVariable("HOME") };
+
+        if (xdg_cache_home.has_value() && !xdg_cache_home->empty()) {
+            shared_cache_dir_path = std::filesystem::path(*xdg_cache_home) / SharedCacheDirBasename;
+        } else if (windows && local_app_data.has_value()) {
+            shared_cache_dir_path = std::filesystem::path(*local_app_data) / SharedCacheDirBasename;
+        } else if (home.has_value()) {
+            shared_cache_dir_path = std::filesystem::path(*home) / ".cache" / SharedCacheDirBasename;
+        }
+    } else if (translation_units.empty() && !shared_cache.empty() && shared_cache != "0") {
+        shared_cache_dir_path = shared_cache;
+    }
+
+    ComposeBuildCommand();
+}
+
+void Config::SelectCompiler() {
+    const std::vector<std::filesystem::path> sources{ translation_units.empty() ? std::vector<std::filesystem::path>{ task_definition_path } : std::vector<std::filesystem::path>{ translation_units.front().source_path } };
+
+    // Module imports need compiler specific flags, which the timing builds lack.
+    if (ImportsModule(sources.front())) {
+        return;
+    }
+
+    const std::vector<std::string> names{ task_definition_lang == Lang::Cpp ? std::vector<std::string>{ "c++", "g++", "clang++" } : std::vector<std::string>{ "cc", "gcc", "clang", "tcc" } };
+    std::vector<std::string> candidates;
+    std::set<std::filesystem::path> resolved_paths;
+    std::string key_seed;
+
+    for (const std::string &name : names) {
+        const std::optional<std::filesystem::path> path{ FindExecutable(name, false) };
+
+        if (!path.has_value()) {
+            continue;
+        }
+
+        // c++ and cc are often links to g++ and gcc.
+        std::error_code ec;
+        const std::filesystem::path resolved_path{ std::filesystem::weakly_canonical(*path, ec) };
+
+        if (!resolved_paths.insert(ec ? *path : resolved_path).second) {
+            continue;
+        }
+
+        candidates.push_back(name);
+        key_seed += name + '\0' + path->string() + '\0';
+    }
+
+    if (candidates.size() < 2) {
+        return;
+    }
+
+    for (const std::string &flag : flags) {
+        key_seed += '\0';
+        key_seed += flag;
+    }
+
+    const std::string entry_prefix_s{ task_definition_lang == Lang::Cpp ? "cpp\t"s : "c\t"s };
+    const std::string entry_key_s{ entry_prefix_s + HexDigest(HashBytes(key_seed.data(), key_seed.size(), 0)) + "\t" };
+    const std::filesystem::path cache_path{ std::filesystem::path(CacheDir) / CompilerChoiceBasename };
+
+    {
+        std::ifstream cache(cache_path);
+        std::string line;
+
+        while (getline(cache, line)) {
+            if (line.rfind(entry_key_s, 0) == 0) {
+                compiler = line.substr(entry_key_s.size());
+                return;
+            }
+        }
+    }
+
+    std::filesystem::create_directories(CacheDir);
+    const std::filesystem::path probe_path{ std::filesystem::path(CacheDir) / ("rez-compiler-probe-" + std::to_string(CurrentProcessId())) };
+    std::string fastest;
+    std::chrono::steady_clock::duration fastest_elapsed{ std::chrono::steady_clock::duration::max() };
+
+    for (const std::string &candidate : candidates) {
+        // Mirror the delegate build, including dependency tracking, so that the winner also accepts the real build command.
+        std::vector<std::string> argv{ candidate };
+        argv.insert(argv.end(), flags.begin(), flags.end());
+
+        if (!translation_units.empty()) {
+            argv.emplace_back("-c");
+        }
+
+        argv.insert(argv.end(), { "-o", probe_path.string(), "-MMD", "-MF", probe_path.string() + ".d", sources.front().string() });
+        const auto start{ std::chrono::steady_clock::now() };
+        int status{ EXIT_FAILURE };
+
+        try {
+            Process process(argv, RunOptions{ true, true });
+            status = process.Wait();
+        } catch (const std::runtime_error &) {
+            status = EXIT_FAILURE;
+        }
+
+        const auto elapsed{ std::chrono::steady_clock::now() - start };
+        std::error_code ec;
+        std::filesystem::remove(probe_path, ec);
+        std::filesystem::remove(probe_path.string() + ".d", ec);
+
+        if (debug) {
+            std::cerr << "timed compiler: " << candidate << ": " << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms" << (status == EXIT_SUCCESS ? "" : " (failed)") << "\n";
+        }
+
+        if (status == EXIT_SUCCESS && elapsed < fastest_elapsed) {
+            fastest = candidate;
+            fastest_elapsed = elapsed;
+        }
+    }
+
+    if (fastest.empty()) {
+        return;
+    }
+
+    compiler = fastest;
+
+    // Merge with any selections which concurrent rez processes recorded meanwhile.
+    const FileLock lock(std::filesystem::path(CacheDir) / LockFileBasename);
+    std::vector<std::string> entries;
+
+    {
+        std::ifstream cache(cache_path);
+        std::string line;
+
+        while (getline(cache, line)) {
+            // Drop stale selections for this language.
+            if (line.rfind(entry_prefix_s, 0) != 0) {
+                entries.push_back(line);
+            }
+        }
+    }
+
+    entries.push_back(entry_key_s + compiler);
+
+    std::filesystem::path temp_path{ cache_path };
+    temp_path += ".tmp";
+
+    {
+        std::ofstream cache(temp_path, std::ios::trunc);
+
+        for (const std::string &line : entries) {
+            cache << line << "\n";
+        }
+
+        if (!cache) {
+            throw std::runtime_error("error writing compiler selection cache: "s + temp_path.string());
+        }
+    }
+
+    std::filesystem::rename(temp_path, cache_path);
+}
+
+/**
+ * @brief CompilerWrappers lists launchers which delegate to another compiler, such as ccache.
+ */
+static const std::set<std::string> CompilerWrappers{ "buildcache", "ccache", "distcc", "icecc", "sccache" };
+
+/**
+ * @brief WrappedCompiler locates the compiler behind a compiler wrapper.
+ *
+ * Wrappers either name the compiler as their first operand (ccache g++), or masquerade as the compiler via symlinks (g++ -> ccache), deferring to the next g++ in PATH.
+ *
+ * @param compiler_argv the compiler command
+ * @param compiler_path the canonical path of compiler_argv's executable
+ * @param windows whether to apply Windows conventions
+ * @returns the canonical path of the wrapped compiler; or std::nullopt when compiler_path is no wrapper, or the wrapped compiler is not found
+ */
+static std::optional<std::filesystem::path> WrappedCompiler(const std::vector<std::string> &compiler_argv, const std::filesystem::path &compiler_path, bool windows) {
+    if (CompilerWrappers.find(compiler_path.stem().string()) == CompilerWrappers.end()) {
+        return std::nullopt;
+    }
+
+    std::error_code ec;
+
+    for (std::size_t i{ 1 }; i < compiler_argv.size(); i++) {
+        if (compiler_argv[i].empty() || compiler_argv[i][0] == '-') {
+            continue;
+        }
+
+        const std::optional<std::filesystem::path> wrapped_path{ FindExecutable(compiler_argv[i], windows) };
+
+        if (!wrapped_path.has_value()) {
+            return std::nullopt;
+        }
+
+        const std::filesystem::path wrapped_canonical{ std::filesystem::canonical(*wrapped_path, ec) };
+        return ec ? *wrapped_path : wrapped_canonical;
+    }
+
+    const std::filesystem::path name{ std::filesystem::path(compiler_argv.front()).filename() };
+    std::stringstream ss(GetEnvironmentVariable("PATH").value_or(""));
+    std::string dir;
+
+    while (getline(ss, dir, windows ? ';' : ':')) {
+        if (dir.empty()) {
+            continue;
+        }
+
+        const std::filesystem::path candidate{ std::filesystem::canonical(std::filesystem::path(dir) / name, ec) };
+
+        if (!ec && CompilerWrappers.find(candidate.stem().string()) == CompilerWrappers.end()) {
+            return candidate;
+        }
+    }
+
+    return std::nullopt;
+}
+
+void Config::FingerprintCompiler() {
+    const std::vector<std::string> compiler_argv{ SplitArguments(compiler) };
+    const std::optional<std::string> linker_override{ GetEnvironmentVariable("REZ_LINKER") };
+    std::vector<std::string> linker_candidates;
+    linker_flag.clear();
+
+    if (compiler == DefaultCompilerWindows) {
+        // cl links with link.exe.
+    } else if (linker_override.has_value() && !linker_override->empty()) {
+        if (*linker_override != "default") {
+            linker_flag = "-fuse-ld=" + *linker_override;
+        }
+    } else {
+        if (FindExecutable("mold", windows).has_value()) {
+            linker_candidates.emplace_back("mold");
+        }
+
+        if (FindExecutable("ld.lld", windows).has_value()) {
+            linker_candidates.emplace_back("lld");
+        }
+    }
+
+    const std::optional<std::filesystem::path> compiler_path_opt{ compiler_argv.empty() ? std::nullopt : FindExecutable(compiler_argv.front(), windows) };
+
+    if (!compiler_path_opt.has_value()) {
+        compiler_fingerprint = "";
+        return;
+    }
+
+    std::error_code ec;
+    std::filesystem::path compiler_path{ std::filesystem::canonical(*compiler_path_opt, ec) };
+
+    if (ec) {
+        compiler_path = *compiler_path_opt;
+    }
+
+    const std::optional<FileStat> stat{ StateDatabase::Stat(compiler_path) };
+
+    if (!stat.has_value()) {
+        compiler_fingerprint = "";
+        return;
+    }
+
+    // Each line records: command, language, path, inode, size, mtime, any wrapped compiler, linker candidates, then the probed version, target, standard, and linker flag.
+    std::stringstream entry_prefix;
+    entry_prefix << compiler << "\t" << task_definition_lang << "\t";
+    const std::string entry_prefix_s{ entry_prefix.str() };
+
+    std::stringstream entry_key;
+    entry_key << entry_prefix_s << compiler_path.string() << "\t" << stat->inode << "\t" << stat->size << "\t" << stat->mtime << "\t";
+
+    // Upgrading the compiler behind a wrapper must invalidate the entry, too.
+    const std::optional<std::filesystem::path> wrapped_path{ WrappedCompiler(compiler_argv, compiler_path, windows) };
+    const std::optional<FileStat> wrapped_stat{ wrapped_path.has_value() ? StateDatabase::Stat(*wrapped_path) : std::nullopt };
+
+    if (wrapped_stat.has_value()) {
+        entry_key << wrapped_path->string() << " " << wrapped_stat->inode << " " << wrapped_stat->size << " " << wrapped_stat->mtime;
+    }
+
+    entry_key << "\t";
+
+    for (const std::string &linker_candidate : linker_candidates) {
+        entry_key << linker_candidate << " ";
+    }
+
+    entry_key << "\t";
+    const std::string entry_key_s{ entry_key.str() };
+    const std::filesystem::path cache_path{ std::filesystem::path(CacheDir) / CompilerFingerprintBasename };
+
+    {
+        std::ifstream cache(cache_path);
+        std::string line;
+
+        while (getline(cache, line)) {
+            if (line.rfind(entry_key_s, 0) == 0) {
+                std::string fields{ line.substr(entry_key_s.size()) };
+                const std::size_t i{ fields.rfind('\t') };
+
+                if (i == std::string::npos) {
+                    continue;
+                }
+
+                if (!linker_candidates.empty()) {
+                    linker_flag = fields.substr(i + 1);
+                }
+
+                fields.erase(i);
+                std::replace(fields.begin(), fields.end(), '\t', '\n');
+                compiler_fingerprint = compiler_path.string() + "\n" + fields;
+                return;
+            }
+        }
+    }
+
+    if (debug) {
+        std::cerr << "probing compiler: " << compiler_path.string() << "\n";
+    }
+
+    const std::vector<std::string> probe{ ProbeCompiler(compiler_argv, task_definition_lang, compiler == DefaultCompilerWindows) };
+    compiler_fingerprint = compiler_path.string() + "\n" + probe[0] + "\n" + probe[1] + "\n" + probe[2];
+    std::string probed_linker_flag;
+
+    for (const std::string &linker_candidate : linker_candidates) {
+        if (ProbeLinker(compiler_argv, "-fuse-ld=" + linker_candidate)) {
+            probed_linker_flag = "-fuse-ld=" + linker_candidate;
+            linker_flag = probed_linker_flag;
+            break;
+        }
+    }
+
+    // Merge with any probes which concurrent rez processes recorded meanwhile.
+    const FileLock lock(std::filesystem::path(CacheDir) / LockFileBasename);
+    std::vector<std::string> entries;
+
+    {
+        std::ifstream cache(cache_path);
+        std::string line;
+
+        while (getline(cache, line)) {
+            // Keep probes of other compilers, but drop stale probes of this one.
+            if (line.rfind(entry_prefix_s, 0) != 0) {
+                entries.push_back(line);
+            }
+        }
+    }
+
+    entries.push_back(entry_key_s + probe[0] + "\t" + probe[1] + "\t" + probe[2] + "\t" + probed_linker_flag);
+
+    std::filesystem::path temp_path{ cache_path };
+    temp_path += ".tmp";
+
+    {
+        std::ofstream cache(temp_path, std::ios::trunc);
+
+        for (const std::string &line : entries) {
+            cache << line << "\n";
+        }
+
+        if (!cache) {
+            throw std::runtime_error("error writing compiler fingerprint cache: "s + temp_path.string());
+        }
+    }
+
+    std::filesystem::rename(temp_path, cache_path);
+}
+
+void Config::ComposeBuildCommand() {
+    const std::string artifact_file_path_s{ artifact_temp_file_path.string() };
+    const std::filesystem::path prelude_path{ pch_dir_path / (task_definition_lang == Lang::Cpp ? PreludeBasenameCpp : PreludeBasenameC) };
+    const std::string prelude_path_s{ prelude_path.string() };
+    build_argv = SplitArguments(compiler);
+    pch_build_argv = build_argv;
+
+    const ModuleFlavor module_flavor{ DetectModuleFlavor(compiler, compiler_fingerprint) };
+    const std::string module_interface_path_s{ (module_dir_path / ModuleInterfaceBasename).string() };
+    const std::string compiled_module_path_s{ CompiledModulePath(module_flavor, module_dir_path).string() };
+    const std::string module_object_path_s{ ModuleObjectPath(module_flavor, module_dir_path).string() };
+    std::vector<std::string> module_flags;
+    module_build_argv.clear();
+
+    if (module) {
+        module_build_argv = build_argv;
+
+        switch (module_flavor) {
+        case ModuleFlavor::GCC:
+            module_flags = { "-fmodules-ts", "-fmodule-mapper=" + (module_dir_path / "rez.map").string() };
+            module_build_argv.insert(module_build_argv.end(), flags.begin(), flags.end());
+            module_build_argv.insert(module_build_argv.end(), module_flags.begin(), module_flags.end());
+            module_build_argv.insert(module_build_argv.end(), { "-x", "c++", "-c", "-o", module_object_path_s, "-MMD", "-MF", (module_dir_path / ModuleDepfileBasenameUnix).string(), module_interface_path_s });
+            break;
+        case ModuleFlavor::Clang:
+            module_flags = { "-fmodule-file=rez=" + compiled_module_path_s };
+            module_build_argv.insert(module_build_argv.end(), flags.begin(), flags.end());
+            module_build_argv.insert(module_build_argv.end(), { "-x", "c++-module", "-fmodule-output=" + compiled_module_path_s, "-c", "-o", module_object_path_s, "-MMD", "-MF", (module_dir_path / ModuleDepfileBasenameUnix).string(), module_interface_path_s });
+            break;
+        case ModuleFlavor::MSVC:
+            module_flags = { "/reference", "rez=" + compiled_module_path_s };
+            module_build_argv.emplace_back("/c");
+            module_build_argv.insert(module_build_argv.end(), flags.begin(), flags.end());
+            module_build_argv.insert(module_build_argv.end(), { "/interface", "/TP", "/ifcOutput", compiled_module_path_s, "/Fo" + module_object_path_s, "/sourceDependencies", (module_dir_path / ModuleDepfileBasenameMSVC).string(), module_interface_path_s });
+            break;
+        }
+    }
+
+    if (compiler == DefaultCompilerWindows) {
+        const std::string pch_file_path_s{ (pch_dir_path / PchFileBasenameMSVC).string() };
+        const std::string pch_object_path_s{ (pch_dir_path / PchObjectBasenameMSVC).string() };
+
+        if (translation_units.empty()) {
+            build_argv.insert(build_argv.end(), flags.begin(), flags.end());
+
+            if (pch) {
+                build_argv.insert(build_argv.end(), { "/FI" + prelude_path_s, "/Yu" + prelude_path_s, "/Fp" + pch_file_path_s });
+            }
+
+            build_argv.insert(build_argv.end(), module_flags.begin(), module_flags.end());
+            build_argv.insert(build_argv.end(), { "/sourceDependencies", depfile_path.string(), task_definition_path.string() });
+        }
+
+        for (TranslationUnit &translation_unit : translation_units) {
+            translation_unit.build_argv = SplitArguments(compiler);
+            translation_unit.build_argv.emplace_back("/c");
+            translation_unit.build_argv.insert(translation_unit.build_argv.end(), flags.begin(), flags.end());
+
+            if (pch) {
+                translation_unit.build_argv.insert(translation_unit.build_argv.end(), { "/FI" + prelude_path_s, "/Yu" + prelude_path_s, "/Fp" + pch_file_path_s });
+            }
+
+            translation_unit.build_argv.insert(translation_unit.build_argv.end(), module_flags.begin(), module_flags.end());
+            translation_unit.build_argv.insert(translation_unit.build_argv.end(), { "/sourceDependencies", translation_unit.depfile_path.string(), "/Fo" + translation_unit.object_path.string(), translation_unit.source_path.string() });
+            build_argv.push_back(translation_unit.object_path.string());
+        }
+
+        if (pch) {
+            build_argv.push_back(pch_object_path_s);
+        }
+
+        if (module) {
+            build_argv.push_back(module_object_path_s);
+        }
+
+        build_argv.insert(build_argv.end(), { "/link", "/out:" + artifact_file_path_s });
+
+        pch_build_argv.emplace_back("/c");
+        pch_build_argv.insert(pch_build_argv.end(), flags.begin(), flags.end());
+        pch_build_argv.insert(pch_build_argv.end(), { "/FI" + prelude_path_s, "/Yc" + prelude_path_s, "/Fp" + pch_file_path_s, "/Fo" + pch_object_path_s, "/sourceDependencies", (pch_dir_path / PchDepfileBasenameMSVC).string(), PrecompiledHeaderSourcePath().string() });
+    } else {
+        if (delegate_mode == DelegateMode::SharedObject) {
+            build_argv.emplace_back("-shared");
+        }
+
+        if (translation_units.empty()) {
+            build_argv.insert(build_argv.end(), { "-o", artifact_file_path_s, "-MMD", "-MF", depfile_path.string() });
+            build_argv.insert(build_argv.end(), flags.begin(), flags.end());
+
+            if (!linker_flag.empty()) {
+                build_argv.push_back(linker_flag);
+            }
+
+            if (pch) {
+                build_argv.insert(build_argv.end(), { "-include", prelude_path_s });
+            }
+
+            build_argv.insert(build_argv.end(), module_flags.begin(), module_flags.end());
+            build_argv.push_back(task_definition_path.string());
+        } else {
+            // Link flags such as -pthread and -fsanitize also appear in CPPFLAGS, CXXFLAGS, and CFLAGS.
+            build_argv.insert(build_argv.end(), { "-o", artifact_file_path_s });
+            build_argv.insert(build_argv.end(), flags.begin(), flags.end());
+
+            if (!linker_flag.empty()) {
+                build_argv.push_back(linker_flag);
+            }
+        }
+
+        for (TranslationUnit &translation_unit : translation_units) {
+            translation_unit.build_argv = SplitArguments(compiler);
+            translation_unit.build_argv.insert(translation_unit.build_argv.end(), { "-c", "-o", translation_unit.object_path.string(), "-MMD", "-MF", translation_unit.depfile_path.string() });
+            translation_unit.build_argv.insert(translation_unit.build_argv.end(), flags.begin(), flags.end());
+
+            if (pch) {
+                translation_unit.build_argv.insert(translation_unit.build_argv.end(), { "-include", prelude_path_s });
+            }
+
+            translation_unit.build_argv.insert(translation_unit.build_argv.end(), module_flags.begin(), module_flags.end());
+            translation_unit.build_argv.push_back(translation_unit.source_path.string());
+            build_argv.push_back(translation_unit.object_path.string());
+        }
+
+        if (module) {
+            build_argv.push_back(module_object_path_s);
+        }
+
+        pch_build_argv.insert(pch_build_argv.end(), flags.begin(), flags.end());
+        pch_build_argv.insert(pch_build_argv.end(), { "-MMD", "-MF", (pch_dir_path / PchDepfileBasenameUnix).string(), "-x", task_definition_lang == Lang::Cpp ? "c++-header" : "c-header", "-o", prelude_path_s + ".gch", prelude_path_s });
+    }
+
+    if (!pch) {
+        pch_build_argv.clear();
+    }
+}
+
+std::filesystem::path Config::PrecompiledHeaderSourcePath() const {
+    return pch_dir_path / (task_definition_lang == Lang::Cpp ? "rez-prelude.cpp" : "rez-prelude.c");
+}
+
+bool Config::BuildPrecompiledHeader() {
+    if (!pch) {
+        return false;
+    }
+
+    const std::filesystem::path prelude_path{ pch_dir_path / (task_definition_lang == Lang::Cpp ? PreludeBasenameCpp : PreludeBasenameC) };
+    std::filesystem::path pch_file_path{ pch_dir_path / PchFileBasenameMSVC };
+
+    if (compiler != DefaultCompilerWindows) {
+        pch_file_path = prelude_path;
+        pch_file_path += ".gch";
+    }
+
+    const std::filesystem::path pch_manifest_path{ pch_dir_path / PchManifestBasename };
+
+    if (std::filesystem::exists(pch_file_path)) {
+        std::ifstream pch_manifest(pch_manifest_path);
+        std::string recorded_key;
+
+        if (getline(pch_manifest, recorded_key) && recorded_key == HexDigest(HashDependencies(PrecompiledHeaderDependencies(), 0))) {
+            return true;
+        }
+    }
+
+    std::filesystem::create_directories(pch_dir_path);
+
+    {
+        std::ofstream prelude(prelude_path, std::ios::trunc);
+        // The API header comes first, so that its feature test macros precede any system header.
+        if (pch_api) {
+            prelude << (task_definition_lang == Lang::Cpp ? PreludeCppApi : PreludeCApi);
+        }
+
+        prelude << (task_definition_lang == Lang::Cpp ? PreludeCpp : PreludeC);
+    }
+
+    if (compiler == DefaultCompilerWindows) {
+        std::ofstream pch_source(PrecompiledHeaderSourcePath(), std::ios::trunc);
+    }
+
+    if (debug) {
+        std::cerr << "running precompiled header command: " << JoinArguments(pch_build_argv) << "\n";
+    }
+
+    int status{ EXIT_FAILURE };
+
+    {
+        const Span span("precompiled header", "rez");
+        status = Spawn(pch_build_argv);
+    }
+
+    const std::string pch_key{ HexDigest(HashDependencies(PrecompiledHeaderDependencies(), 0)) };
+
+    if (status == EXIT_SUCCESS) {
+        std::filesystem::remove(pch_dir_path / PchDisabledBasename);
+        std::ofstream pch_manifest(pch_manifest_path, std::ios::trunc);
+        pch_manifest << pch_key << "\n";
+        return true;
+    }
+
+    if (debug) {
+        std::cerr << "disabling precompiled header: " << pch_dir_path.string() << "\n";
+    }
+
+    std::ofstream marker(pch_dir_path / PchDisabledBasename, std::ios::trunc);
+    marker << pch_key << "\n";
+    pch = false;
+    ComposeBuildCommand();
+    return false;
+}
+
+std::vector<std::filesystem::path> Config::PrecompiledHeaderDependencies() const {
+    if (!pch) {
+        return {};
+    }
+
+    if (compiler == DefaultCompilerWindows) {
+        return Dependencies(pch_dir_path / PchDepfileBasenameMSVC, PrecompiledHeaderSourcePath());
+    }
+
+    return Dependencies(pch_dir_path / PchDepfileBasenameUnix, pch_dir_path / (task_definition_lang == Lang::Cpp ? PreludeBasenameCpp : PreludeBasenameC));
+}
+
+std::vector<std::filesystem::path> Config::ModuleDependencies() const {
+    if (!module) {
+        return {};
+    }
+
+    return Dependencies(module_dir_path / (compiler == DefaultCompilerWindows ? ModuleDepfileBasenameMSVC : ModuleDepfileBasenameUnix), module_dir_path / ModuleInterfaceBasename);
+}
+
+int Config::BuildModule() const {
+    if (!module) {
+        return EXIT_SUCCESS;
+    }
+
+    const ModuleFlavor module_flavor{ DetectModuleFlavor(compiler, compiler_fingerprint) };
+    const std::filesystem::path module_manifest_path{ module_dir_path / ModuleManifestBasename };
+
+    if (std::filesystem::exists(CompiledModulePath(module_flavor, module_dir_path)) && std::filesystem::exists(ModuleObjectPath(module_flavor, module_dir_path))) {
+        std::ifstream module_manifest(module_manifest_path);
+        std::string recorded_key;
+
+        if (getline(module_manifest, recorded_key) && recorded_key == HexDigest(HashDependencies(ModuleDependencies(), 0))) {
+            return EXIT_SUCCESS;
+        }
+    }
+
+    std::filesystem::create_directories(module_dir_path);
+
+    {
+        std::ofstream module_interface(module_dir_path / ModuleInterfaceBasename, std::ios::trunc);
+        module_interface << ModuleInterface;
+    }
+
+    if (module_flavor == ModuleFlavor::GCC) {
+        std::ofstream module_mapper(module_dir_path / "rez.map", std::ios::trunc);
+        module_mapper << "rez " << CompiledModulePath(module_flavor, module_dir_path).string() << "\n";
+    }
+
+    if (debug) {
+        std::cerr << "running module command: " << JoinArguments(module_build_argv) << "\n";
+    }
+
+    int status{ EXIT_FAILURE };
+
+    {
+        const Span span("module", "rez");
+        status = Spawn(module_build_argv);
+    }
+
+    if (status != EXIT_SUCCESS) {
+        std::cerr << "error building rez module: " << (module_dir_path / ModuleInterfaceBasename).string() << "\n";
+        return status;
+    }
+
+    std::ofstream module_manifest(module_manifest_path, std::ios::trunc);
+    module_manifest << HexDigest(HashDependencies(ModuleDependencies(), 0)) << "\n";
+    return EXIT_SUCCESS;
+}
+
+std::string Config::CacheKey() const {
+    const std::string &identity = compiler_fingerprint;
+
+    if (translation_units.empty()) {
+        return HexDigest(HashBuildInputs(task_definition_path, compiler, build_argv, Concatenate(Dependencies(), Concatenate(PrecompiledHeaderDependencies(), ModuleDependencies())), identity));
+    }
+
+    const std::vector<std::filesystem::path> prebuilt_dependencies{ Concatenate(PrecompiledHeaderDependencies(), ModuleDependencies()) };
+    std::uint64_t h{ 0 };
+
+    for (const std::string &arg : build_argv) {
+        h = HashBytes(arg.data(), arg.size() + 1, h);
+    }
+
+    for (const TranslationUnit &translation_unit : translation_units) {
+        const std::uint64_t object_key{ HashBuildInputs(translation_unit.source_path, compiler, translation_unit.build_argv, Concatenate(Dependencies(translation_unit.depfile_path, translation_unit.source_path), prebuilt_dependencies), identity) };
+        h = HashBytes(reinterpret_cast<const char *>(&object_key), sizeof(object_key), h);
+    }
+
+    return HexDigest(h);
+}
+
+std::vector<std::filesystem::path> Config::Dependencies() const {
+    return Dependencies(depfile_path, task_definition_path);
+}
+
+std::vector<std::filesystem::path> Config::Dependencies(const std::filesystem::path &dependency_file_path, const std::filesystem::path &source) const {
+    std::ifstream depfile(dependency_file_path, std::ios::binary);
+
+    if (!depfile) {
+        return {};
+    }
+
+    const std::string contents{ std::istreambuf_iterator<char>(depfile), std::istreambuf_iterator<char>() };
+
+    if (compiler != DefaultCompilerWindows) {
+        std::vector<std::filesystem::path> dependencies{ ParseDepfile(contents) };
+        dependencies.erase(
+            std::remove(dependencies.begin(), dependencies.end(), source),
+            dependencies.end());
+        return dependencies;
+    }
+
+    // Unlike -MMD, cl reports system headers as well. Skip those under the MSVC INCLUDE directories.
+    std::vector<std::string> system_dirs;
+    std::stringstream ss(GetEnvironmentVariable("INCLUDE").value_or(""));
+    std::string system_dir;
+
+    while (getline(ss, system_dir, ';')) {
+        if (!system_dir.empty()) {
+            std::transform(system_dir.begin(), system_dir.end(), system_dir.begin(), [](unsigned char c) { return tolower(c); });
+            system_dirs.push_back(system_dir);
+        }
+    }
+
+    std::vector<std::filesystem::path> dependencies;
+
+    for (const std::filesystem::path &include : ParseSourceDependencies(contents)) {
+        std::string include_s{ include.string() };
+        std::transform(include_s.begin(), include_s.end(), include_s.begin(), [](unsigned char c) { return tolower(c); });
+
+        if (std::none_of(system_dirs.begin(), system_dirs.end(), [&include_s](const std::string &dir) { return include_s.rfind(dir, 0) == 0; })) {
+            dependencies.push_back(include);
+        }
+    }
+
+    return dependencies;
+}
+
+std::vector<std::filesystem::path> Config::BuildInputs() const {
+    std::vector<std::filesystem::path> inputs;
+
+    if (translation_units.empty()) {
+        inputs.push_back(task_definition_path);
+        inputs = Concatenate(inputs, Dependencies());
+    }
+
+    for (const TranslationUnit &translation_unit : translation_units) {
+        inputs.push_back(translation_unit.source_path);
+        inputs = Concatenate(inputs, Dependencies(translation_unit.depfile_path, translation_unit.source_path));
+    }
+
+    return Concatenate(inputs, Concatenate(PrecompiledHeaderDependencies(), ModuleDependencies()));
+}
+
+std::string Config::DigestInputs(const std::vector<std::filesystem::path> &inputs) const {
+    return HexDigest(HashDependencies(inputs, 0));
+}
+
+bool Config::InputsChanged(const std::vector<std::filesystem::path> &inputs, const std::string &digest, const std::filesystem::file_time_type &since) const {
+    return EditedDuringBuild(inputs, std::stoull(digest, nullptr, 16), BuildInputs(), since);
+}
+
+bool Config::ArtifactCacheMiss() const {
+    if (!std::filesystem::exists(artifact_file_path)) {
+        return true;
+    }
+
+    std::ifstream manifest(manifest_path);
+    std::string recorded_key;
+
+    if (!manifest || !getline(manifest, recorded_key)) {
+        return true;
+    }
+
+    const std::string key{ CacheKey() };
+
+    if (debug) {
+        std::cerr << "cache key: " << key << " recorded: " << recorded_key << "\n";
+    }
+
+    return recorded_key != key;
+}
+
+int Config::BuildObjects() const {
+    if (translation_units.empty()) {
+        return EXIT_SUCCESS;
+    }
+
+    const std::string &identity = compiler_fingerprint;
+    const std::vector<std::filesystem::path> prebuilt_dependencies{ Concatenate(PrecompiledHeaderDependencies(), ModuleDependencies()) };
+    std::vector<int> statuses(translation_units.size(), EXIT_SUCCESS);
+    std::mutex log_mutex;
+    std::filesystem::create_directories(translation_units.front().object_path.parent_path());
+
+    {
+        ThreadPool pool(std::min(DefaultJobs(), translation_units.size()));
+
+        for (std::size_t i{ 0 }; i < translation_units.size(); i++) {
+            pool.Submit([this, &identity, &prebuilt_dependencies, &statuses, &log_mutex, i] {
+                const TranslationUnit &translation_unit = translation_units[i];
+
+                try {
+                    std::string recorded_key;
+
+                    if (std::filesystem::exists(translation_unit.object_path)) {
+                        std::ifstream manifest(translation_unit.manifest_path);
+                        getline(manifest, recorded_key);
+                    }
+
+                    if (recorded_key == HexDigest(HashBuildInputs(translation_unit.source_path, compiler, translation_unit.build_argv, Concatenate(Dependencies(translation_unit.depfile_path, translation_unit.source_path), prebuilt_dependencies), identity))) {
+                        return;
+                    }
+
+                    if (debug) {
+                        const std::lock_guard<std::mutex> lock(log_mutex);
+                        std::cerr << "running object build command: " << JoinArguments(translation_unit.build_argv) << "\n";
+                    }
+
+                    const std::vector<std::filesystem::path> inputs{ Concatenate({ translation_unit.source_path }, Dependencies(translation_unit.depfile_path, translation_unit.source_path)) };
+                    const std::uint64_t inputs_digest{ HashDependencies(inputs, 0) };
+                    const std::filesystem::file_time_type build_start{ std::filesystem::file_time_type::clock::now() };
+                    std::filesystem::remove(translation_unit.manifest_path);
+
+                    {
+                        const Span span("compile " + translation_unit.source_path.generic_string(), "rez");
+                        statuses[i] = Spawn(translation_unit.build_argv);
+                    }
+
+                    if (statuses[i] != EXIT_SUCCESS) {
+                        return;
+                    }
+
+                    // Leave objects compiled from sources edited underfoot unrecorded, and so stale.
+                    if (EditedDuringBuild(inputs, inputs_digest, Concatenate({ translation_unit.source_path }, Dependencies(translation_unit.depfile_path, translation_unit.source_path)), build_start)) {
+                        return;
+                    }
+
+                    // Key the object by the headers which this compilation just recorded.
+                    std::ofstream manifest(translation_unit.manifest_path, std::ios::trunc);
+                    manifest << HexDigest(HashBuildInputs(translation_unit.source_path, compiler, translation_unit.build_argv, Concatenate(Dependencies(translation_unit.depfile_path, translation_unit.source_path), prebuilt_dependencies), identity)) << "\n";
+                } catch (const std::exception &err) {
+                    const std::lock_guard<std::mutex> lock(log_mutex);
+                    std::cerr << err.what() << "\n";
+                    statuses[i] = EXIT_FAILURE;
+                }
+            });
+        }
+    }
+
+    for (const int status : statuses) {
+        if (status != EXIT_SUCCESS) {
+            return status;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+void Config::CommitArtifact() const {
+    std::filesystem::rename(artifact_temp_file_path, artifact_file_path);
+}
+
+void Config::SaveCacheKey() const {
+    std::filesystem::create_directories(CacheDir);
+    std::ofstream manifest(manifest_path, std::ios::trunc);
+
+    if (!manifest) {
+        throw std::runtime_error("error writing cache manifest: "s + manifest_path.string());
+    }
+
+    manifest << CacheKey() << "\n";
+}
+
+void Config::ForgetCacheKey() const {
+    std::filesystem::remove(manifest_path);
+}
+
+/**
+ * @brief LinkOrCopy places a file at a destination, hard linking when possible.
+ *
+ * Any existing destination is replaced.
+ *
+ * @param from the source file
+ * @param to the destination file
+ *
+ * @throws an error in the event of a problem
+ */
+static void LinkOrCopy(const std::filesystem::path &from, const std::filesystem::path &to) {
+    std::filesystem::path temp_path{ to };
+    temp_path += ".link" + std::to_string(CurrentProcessId());
+    std::filesystem::remove(temp_path);
+    std::error_code ec;
+    std::filesystem::create_hard_link(from, temp_path, ec);
+
+    if (ec) {
+        // Hard links fail across filesystems.
+        std::filesystem::copy_file(from, temp_path, std::filesystem::copy_options::overwrite_existing);
+    }
+
+    // Rename, so that concurrent readers see either the old file or the new one.
+    std::filesystem::rename(temp_path, to);
+}
+
+std::string Config::SharedCacheKey() const {
+    return HexDigest(HashBuildInputs(task_definition_path, compiler, build_argv, {}, compiler_fingerprint));
+}
+
+bool Config::RestoreSharedArtifact() const {
+    if (shared_cache_dir_path.empty()) {
+        return false;
+    }
+
+    const std::filesystem::path entries_path{ shared_cache_dir_path / SharedCacheKey() };
+    std::error_code ec;
+
+    for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(entries_path, ec)) {
+        const std::filesystem::path entry_artifact_path{ entry.path() / artifact_file_path.filename() };
+        const std::filesystem::path entry_depfile_path{ entry.path() / depfile_path.filename() };
+
+        if (entry.path().extension() == ".tmp" || !std::filesystem::exists(entry_artifact_path)) {
+            continue;
+        }
+
+        // Judge the entry by its recorded headers, as they read in this checkout.
+        std::filesystem::create_directories(CacheDir);
+        std::filesystem::copy_file(entry_depfile_path, depfile_path, std::filesystem::copy_options::overwrite_existing, ec);
+
+        if (!ec && pch) {
+            const std::filesystem::path pch_depfile_path{ pch_dir_path / (compiler == DefaultCompilerWindows ? PchDepfileBasenameMSVC : PchDepfileBasenameUnix) };
+            std::filesystem::create_directories(pch_dir_path);
+            std::filesystem::copy_file(entry.path() / pch_depfile_path.filename(), pch_depfile_path, std::filesystem::copy_options::overwrite_existing, ec);
+        }
+
+        if (ec || CacheKey() != entry.path().filename().string()) {
+            continue;
+        }
+
+        if (debug) {
+            std::cerr << "restoring shared artifact: " << entry_artifact_path.string() << "\n";
+        }
+
+        std::filesystem::create_directories(artifact_dir_path);
+        LinkOrCopy(entry_artifact_path, artifact_file_path);
+        SaveCacheKey();
+        return true;
+    }
+
+    return false;
+}
+
+void Config::PublishSharedArtifact() const {
+    if (shared_cache_dir_path.empty()) {
+        return;
+    }
+
+    const std::filesystem::path entry_path{ shared_cache_dir_path / SharedCacheKey() / CacheKey() };
+
+    if (std::filesystem::exists(entry_path)) {
+        return;
+    }
+
+    std::filesystem::path temp_path{ entry_path };
+    temp_path += "." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+    std::filesystem::create_directories(temp_path);
+    LinkOrCopy(artifact_file_path, temp_path / artifact_file_path.filename());
+    std::filesystem::copy_file(depfile_path, temp_path / depfile_path.filename(), std::filesystem::copy_options::overwrite_existing);
+
+    if (pch) {
+        const std::filesystem::path pch_depfile_path{ pch_dir_path / (compiler == DefaultCompilerWindows ? PchDepfileBasenameMSVC : PchDepfileBasenameUnix) };
+        std::filesystem::copy_file(pch_depfile_path, temp_path / pch_depfile_path.filename(), std::filesystem::copy_options::overwrite_existing);
+    }
+
+    if (debug) {
+        std::cerr << "publishing shared artifact: " << entry_path.string() << "\n";
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, entry_path, ec);
+
+    if (ec) {
+        // Another publisher won the race.
+        std::filesystem::remove_all(temp_path);
+    }
+}
+
+std::ostream &operator<<(std::ostream &os, const Config &o) {
+    return os << "{ cache_file_path: " << o.cache_file_path
+              << ", manifest_path: " << o.manifest_path
+              << ", depfile_path: " << o.depfile_path
+              << ", debug: " << o.debug
               << ", windows: " << o.windows
               << ", task_definition_path: " << o.task_definition_path.string()
               << ", task_definition_lang: " << o.task_definition_lang
               << ", compiler: " << o.compiler
+              << ", compiler_fingerprint: " << std::quoted(o.compiler_fingerprint)
+              << ", linker_flag: " << o.linker_flag
+              << ", delegate_mode: " << o.delegate_mode
+              << ", profile: " << o.profile
               << ", artifact_dir_path: " << o.artifact_dir_path.string()
               << ", artifact_file_path: " << o.artifact_file_path.string()
-              << ", build_command: " << o.build_command
+              << ", artifact_temp_file_path: " << o.artifact_temp_file_path.string()
+              << ", translation_units: " << o.translation_units.size()
+              << ", flags: " << JoinArguments(o.flags)
+              << ", pch: " << o.pch
+              << ", pch_api: " << o.pch_api
+              << ", pch_dir_path: " << o.pch_dir_path.string()
+              << ", pch_build_argv: " << JoinArguments(o.pch_build_argv)
+              << ", module: " << o.module
+              << ", module_dir_path: " << o.module_dir_path.string()
+              << ", module_build_argv: " << JoinArguments(o.module_build_argv)
+              << ", shared_cache_dir_path: " << o.shared_cache_dir_path.string()
+              << ", build_argv: " << JoinArguments(o.build_argv)
               << " }";
 }
+
+/**
+ * @brief Hidden determines whether a path component is a dotfile.
+ *
+ * @param component a path component
+ * @returns true when the component is hidden
+ */
+static bool Hidden(const std::filesystem::path &component) {
+    const std::string name{ component.string() };
+    return name.size() > 1 && name.front() == '.' && name != "..";
+}
+
+/**
+ * @brief WalkTree visits the entries of a directory tree, skipping hidden entries.
+ *
+ * @param root a directory
+ * @param visit an entry callback
+ */
+static void WalkTree(const std::filesystem::path &root, const std::function<void(const std::filesystem::directory_entry &)> &visit) {
+    std::error_code ec;
+    std::filesystem::recursive_directory_iterator it(root, std::filesystem::directory_options::skip_permission_denied, ec);
+
+    for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if (Hidden(it->path().filename())) {
+            it.disable_recursion_pending();
+            continue;
+        }
+
+        visit(*it);
+    }
+}
+
+Watcher::Watcher() {
+#if defined(__linux__)
+    fd_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+
+    if (fd_ < 0) {
+        throw std::runtime_error("error initializing inotify errno: "s + std::to_string(errno));
+    }
+#endif
+}
+
+Watcher::~Watcher() {
+#if defined(__linux__)
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+#endif
+}
+
+bool Watcher::Relevant(const std::filesystem::path &path) const {
+    if (files_.find(path) != files_.end()) {
+        return true;
+    }
+
+    for (const std::filesystem::path &root : trees_) {
+        if (path == root) {
+            return true;
+        }
+
+        const std::filesystem::path relative{ path.lexically_relative(root) };
+
+        if (relative.empty() || *relative.begin() == "..") {
+            continue;
+        }
+
+        if (std::none_of(relative.begin(), relative.end(), Hidden)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Watcher::AddDirectory(const std::filesystem::path &path) {
+#if defined(__linux__)
+    const int wd{ inotify_add_watch(fd_, path.c_str(), IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO) };
+
+    if (wd < 0) {
+        throw std::runtime_error("error watching directory: "s + path.string() + " errno: " + std::to_string(errno));
+    }
+
+    directories_[wd] = path;
+#else
+    (void) path;
+#endif
+}
+
+#if !defined(__linux__)
+/**
+ * @brief Stamps records the modification times of watched files.
+ *
+ * @param files individual files
+ * @param trees directory trees
+ * @returns modification times by path
+ */
+static std::map<std::filesystem::path, std::filesystem::file_time_type> Stamps(const std::set<std::filesystem::path> &files, const std::set<std::filesystem::path> &trees) {
+    std::map<std::filesystem::path, std::filesystem::file_time_type> stamps;
+    std::error_code ec;
+
+    for (const std::filesystem::path &file : files) {
+        const std::filesystem::file_time_type mtime{ std::filesystem::last_write_time(file, ec) };
+
+        if (!ec) {
+            stamps[file] = mtime;
+        }
+    }
+
+    for (const std::filesystem::path &root : trees) {
+        WalkTree(root, [&stamps, &ec](const std::filesystem::directory_entry &entry) {
+            if (entry.is_regular_file(ec)) {
+                const std::filesystem::file_time_type mtime{ entry.last_write_time(ec) };
+
+                if (!ec) {
+                    stamps[entry.path()] = mtime;
+                }
+            }
+        });
+    }
+
+    return stamps;
+}
+#endif
+
+void Watcher::Add(const std::filesystem::path &path) {
+    std::filesystem::path absolute{ std::filesystem::absolute(path).lexically_normal() };
+
+    if (!absolute.has_filename()) {
+        absolute = absolute.parent_path();
+    }
+
+    std::error_code ec;
+
+    if (std::filesystem::is_directory(absolute, ec)) {
+        if (!trees_.insert(absolute).second) {
+            return;
+        }
+
+        AddDirectory(absolute);
+
+        WalkTree(absolute, [this, &ec](const std::filesystem::directory_entry &entry) {
+            if (entry.is_directory(ec)) {
+                AddDirectory(entry.path());
+            }
+        });
+    } else if (std::filesystem::exists(absolute, ec)) {
+        if (!files_.insert(absolute).second) {
+            return;
+        }
+
+        AddDirectory(absolute.parent_path());
+    } else {
+        return;
+    }
+
+#if !defined(__linux__)
+    stamps_ = Stamps(files_, trees_);
+#endif
+}
+
+bool Watcher::Collect(std::set<std::filesystem::path> &changes, int timeout_ms) {
+#if defined(__linux__)
+    pollfd pfd{ fd_, POLLIN, 0 };
+    const int ready{ poll(&pfd, 1, timeout_ms) };
+
+    if (ready < 0) {
+        if (errno == EINTR) {
+            return false;
+        }
+
+        throw std::runtime_error("error polling inotify errno: "s + std::to_string(errno));
+    }
+
+    if (ready == 0) {
+        return false;
+    }
+
+    alignas(inotify_event) char buffer[16384];
+    const ssize_t length{ read(fd_, buffer, sizeof(buffer)) };
+
+    if (length < 0) {
+        if (errno == EINTR || errno == EAGAIN) {
+            return false;
+        }
+
+        throw std::runtime_error("error reading inotify errno: "s + std::to_string(errno));
+    }
+
+    for (ssize_t offset{ 0 }; offset < length;) {
+        inotify_event event{};
+        memcpy(&event, buffer + offset, sizeof(event));
+        const char *name{ buffer + offset + static_cast<ssize_t>(sizeof(event)) };
+        offset += static_cast<ssize_t>(sizeof(event) + event.len);
+
+        if ((event.mask & IN_Q_OVERFLOW) != 0) {
+            // Events were lost. Report every root.
+            changes.insert(files_.begin(), files_.end());
+            changes.insert(trees_.begin(), trees_.end());
+            continue;
+        }
+
+        const auto directory{ directories_.find(event.wd) };
+
+        if (directory == directories_.end()) {
+            continue;
+        }
+
+        if ((event.mask & IN_IGNORED) != 0) {
+            directories_.erase(directory);
+            continue;
+        }
+
+        const std::filesystem::path changed{ event.len > 0 ? directory->second / name : directory->second };
+
+        if (!Relevant(changed)) {
+            continue;
+        }
+
+        if ((event.mask & IN_ISDIR) != 0 && (event.mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+            AddDirectory(changed);
+
+            std::error_code ec;
+            WalkTree(changed, [this, &ec](const std::filesystem::directory_entry &entry) {
+                if (entry.is_directory(ec)) {
+                    AddDirectory(entry.path());
+                }
+            });
+        }
+
+        changes.insert(changed);
+    }
+
+    return true;
+#else
+    std::this_thread::sleep_for(timeout_ms < 0 ? WatchDebounce : std::chrono::milliseconds(timeout_ms));
+    std::map<std::filesystem::path, std::filesystem::file_time_type> stamps{ Stamps(files_, trees_) };
+    bool activity{ false };
+
+    for (const auto &[path, mtime] : stamps) {
+        const auto previous{ stamps_.find(path) };
+
+        if (previous == stamps_.end() || previous->second != mtime) {
+            changes.insert(path);
+            activity = true;
+        }
+    }
+
+    for (const auto &[path, mtime] : stamps_) {
+        if (stamps.find(path) == stamps.end()) {
+            changes.insert(path);
+            activity = true;
+        }
+    }
+
+    stamps_ = std::move(stamps);
+    return activity;
+#endif
+}
+
+std::vector<std::filesystem::path> Watcher::Wait(std::chrono::milliseconds debounce) {
+    std::set<std::filesystem::path> changes;
+
+    while (changes.empty()) {
+        Collect(changes, -1);
+    }
+
+    // Editors and tools often save in bursts.
+    while (Collect(changes, static_cast<int>(debounce.count()))) {
+    }
+
+    return { changes.begin(), changes.end() };
+}
+
+void Watcher::Drain() {
+    std::set<std::filesystem::path> discarded;
+
+    while (Collect(discarded, 0)) {
+    }
+}
+
+#if !defined(_WIN32)
+/**
+ * @brief ServerMessageLimit bounds the size of a client request, in bytes.
+ */
+static constexpr std::uint64_t ServerMessageLimit{ 64 * 1024 * 1024 };
+
+/**
+ * @brief ServerDeclined denotes the status reply which asks a client to run its tasks itself.
+ */
+static constexpr std::int32_t ServerDeclined{ -1 };
+
+/**
+ * @brief OpenServerPipe opens a pipe whose ends close on exec.
+ *
+ * @param fds the read and write ends to populate
+ * @returns zero on success
+ */
+static int OpenServerPipe(int (&fds)[2]) {
+    // Request threads spawn concurrently, so keep both ends out of their children.
+#if defined(__APPLE__)
+    // macOS lacks pipe2. Narrow the window, at least.
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+#else
+    return pipe2(fds, O_CLOEXEC);
+#endif
+}
+
+/**
+ * @brief SendFlags suppresses SIGPIPE when the peer has disconnected, where supported.
+ */
+#if defined(MSG_NOSIGNAL)
+static constexpr int SendFlags{ MSG_NOSIGNAL };
+#else
+static constexpr int SendFlags{ 0 };
+#endif
+
+/**
+ * @brief SendAll writes a buffer to a socket.
+ *
+ * @param fd a socket
+ * @param data a buffer
+ * @param size the buffer size
+ * @returns true on success
+ */
+static bool SendAll(int fd, const char *data, std::size_t size) {
+    while (size > 0) {
+        const ssize_t n{ send(fd, data, size, SendFlags) };
+
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            return false;
+        }
+
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+
+    return true;
+}
+
+/**
+ * @brief ReceiveAll reads a buffer from a socket.
+ *
+ * @param fd a socket
+ * @param data a buffer
+ * @param size the buffer size
+ * @returns true on success
+ */
+static bool ReceiveAll(int fd, char *data, std::size_t size) {
+    while (size > 0) {
+        const ssize_t n{ recv(fd, data, size, 0) };
+
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            return false;
+        }
+
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+
+    return true;
+}
+
+/**
+ * @brief SocketAddress prepares a unix domain socket address.
+ *
+ * @param path a socket path
+ * @param address the address to populate
+ * @returns false when the path is too long
+ */
+static bool SocketAddress(const std::filesystem::path &path, sockaddr_un &address) {
+    const std::string path_s{ path.string() };
+
+    if (path_s.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path_s.c_str(), path_s.size() + 1);
+    return true;
+}
+
+/**
+ * @brief ConnectSocket connects to a unix domain socket.
+ *
+ * @param path a socket path
+ * @returns a close-on-exec socket descriptor, or -1
+ */
+static int ConnectSocket(const std::filesystem::path &path) {
+    sockaddr_un address{};
+
+    if (!SocketAddress(path, address)) {
+        return -1;
+    }
+
+    const int fd{ socket(AF_UNIX, SOCK_STREAM, 0) };
+
+    if (fd == -1) {
+        return -1;
+    }
+
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    if (connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Reply sends a status to a client, then closes the request descriptors and connection.
+ *
+ * @param connection a connection
+ * @param request a request
+ * @param status a status
+ */
+static void Reply(int connection, const ServerRequest &request, std::int32_t status) {
+    for (const int fd : request.fds) {
+        close(fd);
+    }
+
+    SendAll(connection, reinterpret_cast<const char *>(&status), sizeof(status));
+    close(connection);
+}
+#endif
+
+ServerSocket::ServerSocket(std::filesystem::path path) : path_(std::move(path)) {
+#if defined(_WIN32)
+    throw std::runtime_error("error: rez server is unsupported on Windows");
+#else
+    sockaddr_un address{};
+
+    if (!SocketAddress(path_, address)) {
+        throw std::runtime_error("error: socket path too long: "s + path_.string());
+    }
+
+    const int probe{ ConnectSocket(path_) };
+
+    if (probe != -1) {
+        close(probe);
+        throw std::runtime_error("error: a rez server already listens on: "s + path_.string());
+    }
+
+    // Nothing answers, so any socket file is left over from a server which exited.
+    std::error_code ec;
+    std::filesystem::remove(path_, ec);
+
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd_ == -1) {
+        throw std::runtime_error("error creating socket: "s + path_.string());
+    }
+
+    fcntl(fd_, F_SETFD, FD_CLOEXEC);
+
+    // Clients hand over their standard streams and environment, so only the current user may connect.
+    if (bind(fd_, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 || chmod(path_.c_str(), 0600) != 0 || listen(fd_, 64) != 0) {
+        close(fd_);
+        fd_ = -1;
+        throw std::runtime_error("error listening on socket: "s + path_.string());
+    }
+
+    if (OpenServerPipe(stop_fds_) != 0) {
+        close(fd_);
+        fd_ = -1;
+        std::filesystem::remove(path_, ec);
+        throw std::runtime_error("error creating pipe for socket: "s + path_.string());
+    }
+#endif
+}
+
+ServerSocket::~ServerSocket() {
+#if !defined(_WIN32)
+    if (fd_ != -1) {
+        close(fd_);
+        close(stop_fds_[0]);
+        close(stop_fds_[1]);
+        std::error_code ec;
+        std::filesystem::remove(path_, ec);
+    }
+#endif
+}
+
+void ServerSocket::Stop() const {
+#if !defined(_WIN32)
+    const char byte{ 0 };
+
+    while (write(stop_fds_[1], &byte, 1) == -1 && errno == EINTR) {
+    }
+#endif
+}
+
+int ServerSocket::Accept(ServerRequest &request) const {
+#if defined(_WIN32)
+    (void) request;
+    throw std::runtime_error("error: rez server is unsupported on Windows");
+#else
+    for (;;) {
+        pollfd pfds[2]{ { fd_, POLLIN, 0 }, { stop_fds_[0], POLLIN, 0 } };
+
+        if (poll(pfds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            throw std::runtime_error("error polling socket: "s + path_.string());
+        }
+
+        if (pfds[1].revents != 0) {
+            return -1;
+        }
+
+        if (pfds[0].revents == 0) {
+            continue;
+        }
+
+        const int connection{ accept(fd_, nullptr, nullptr) };
+
+        if (connection == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+
+            throw std::runtime_error("error accepting connection: "s + path_.string());
+        }
+
+        fcntl(connection, F_SETFD, FD_CLOEXEC);
+
+        // The message length arrives alongside the standard stream descriptors.
+        std::uint64_t size{ 0 };
+        iovec iov{ &size, sizeof(size) };
+        alignas(cmsghdr) char control[CMSG_SPACE(3 * sizeof(int))];
+        msghdr message{};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        request = ServerRequest{};
+        ssize_t n{ -1 };
+
+        // Close received descriptors on exec atomically where supported, as other threads fork concurrently.
+#if defined(MSG_CMSG_CLOEXEC)
+        const int receive_flags{ MSG_CMSG_CLOEXEC };
+#else
+        const int receive_flags{ 0 };
+#endif
+
+        do {
+            n = recvmsg(connection, &message, receive_flags);
+        } while (n == -1 && errno == EINTR);
+
+        for (cmsghdr *header = CMSG_FIRSTHDR(&message); n > 0 && header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+                const std::size_t count{ (header->cmsg_len - CMSG_LEN(0)) / sizeof(int) };
+
+                for (std::size_t i{ 0 }; i < count; i++) {
+                    int fd{ -1 };
+                    std::memcpy(&fd, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+                    fcntl(fd, F_SETFD, FD_CLOEXEC);
+                    request.fds.push_back(fd);
+                }
+            }
+        }
+
+        std::string payload;
+        bool ok{ n == static_cast<ssize_t>(sizeof(size)) && request.fds.size() == 3 && size <= ServerMessageLimit };
+
+        if (ok) {
+            payload.resize(static_cast<std::size_t>(size));
+            ok = ReceiveAll(connection, payload.data(), payload.size());
+        }
+
+        // cwd, environment digest, argument count, arguments, then environment entries, each NUL terminated.
+        std::vector<std::string> fields;
+
+        for (std::size_t start{ 0 }; ok && start < payload.size();) {
+            const std::size_t end{ payload.find('\0', start) };
+
+            if (end == std::string::npos) {
+                ok = false;
+                break;
+            }
+
+            fields.push_back(payload.substr(start, end - start));
+            start = end + 1;
+        }
+
+        std::size_t arg_count{ 0 };
+
+        if (ok && fields.size() >= 3 && !fields[2].empty() && fields[2].find_first_not_of("0123456789") == std::string::npos && fields[2].size() < 9) {
+            arg_count = std::stoul(fields[2]);
+        } else {
+            ok = false;
+        }
+
+        if (!ok || fields.size() < 3 + arg_count) {
+            for (const int fd : request.fds) {
+                close(fd);
+            }
+
+            close(connection);
+            continue;
+        }
+
+        request.cwd = fields[0];
+        request.environment_digest = fields[1];
+        request.args.assign(fields.begin() + 3, fields.begin() + 3 + static_cast<std::ptrdiff_t>(arg_count));
+        request.environment.assign(fields.begin() + 3 + static_cast<std::ptrdiff_t>(arg_count), fields.end());
+        return connection;
+    }
+#endif
+}
+
+int ServeRequest(int connection, const ServerRequest &request, const std::vector<std::string> &argv) {
+#if defined(_WIN32)
+    (void) connection;
+    (void) request;
+    (void) argv;
+    return EXIT_FAILURE;
+#else
+    // Other request threads run concurrently, so spawn rather than fork.
+    std::vector<std::string> spawn_argv;
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+
+    for (int i{ 0 }; i < 3; i++) {
+        posix_spawn_file_actions_adddup2(&actions, request.fds[static_cast<std::size_t>(i)], i);
+    }
+
+#if (defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))) || defined(__APPLE__)
+    posix_spawn_file_actions_addchdir_np(&actions, request.cwd.c_str());
+    spawn_argv = argv;
+#else
+    // Change directory through a shell, which then replaces itself with the command.
+    spawn_argv = { "/bin/sh", "-c", "cd -- \"$0\" && exec \"$@\"", request.cwd.string() };
+    spawn_argv.insert(spawn_argv.end(), argv.begin(), argv.end());
+#endif
+
+    std::vector<char *> argv_c;
+
+    for (const std::string &arg : spawn_argv) {
+        argv_c.push_back(const_cast<char *>(arg.c_str()));
+    }
+
+    argv_c.push_back(nullptr);
+    std::vector<char *> envp_c;
+
+    for (const std::string &entry : request.environment) {
+        envp_c.push_back(const_cast<char *>(entry.c_str()));
+    }
+
+    envp_c.push_back(nullptr);
+    pid_t pid{ -1 };
+    const int spawn_status{ posix_spawn(&pid, argv_c[0], &actions, nullptr, argv_c.data(), envp_c.data()) };
+    posix_spawn_file_actions_destroy(&actions);
+
+    // Report spawn failures as a shell would.
+    if (spawn_status != 0) {
+        Reply(connection, request, 127);
+        return 127;
+    }
+
+    // Watch for the child's exit alongside the client connection, so that served runs complete promptly.
+    int exit_fd{ -1 };
+    int exit_pipe[2]{ -1, -1 };
+    int wait_status{ 0 };
+    std::thread waiter;
+
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    // Unavailable before Linux 5.3.
+    exit_fd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#endif
+
+    if (exit_fd == -1) {
+        // Fall back to a self-pipe, written once a waiter thread reaps the child.
+        if (OpenServerPipe(exit_pipe) != 0) {
+            kill(pid, SIGTERM);
+
+            while (waitpid(pid, &wait_status, 0) == -1 && errno == EINTR) {
+            }
+
+            Reply(connection, request, EXIT_FAILURE);
+            return EXIT_FAILURE;
+        }
+
+        exit_fd = exit_pipe[0];
+        waiter = std::thread([pid, &wait_status, write_fd = exit_pipe[1]] {
+            while (waitpid(pid, &wait_status, 0) == -1 && errno == EINTR) {
+            }
+
+            const char byte{ 0 };
+
+            while (write(write_fd, &byte, 1) == -1 && errno == EINTR) {
+            }
+        });
+    }
+
+    bool hung_up{ false };
+
+    for (;;) {
+        pollfd pfds[2]{ { exit_fd, POLLIN, 0 }, { connection, POLLIN, 0 } };
+
+        if (poll(pfds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            hung_up = true;
+            break;
+        }
+
+        if (pfds[0].revents != 0) {
+            break;
+        }
+
+        char byte{ 0 };
+
+        if (pfds[1].revents != 0 && recv(connection, &byte, 1, MSG_DONTWAIT) <= 0) {
+            hung_up = true;
+            break;
+        }
+    }
+
+    if (hung_up) {
+        kill(pid, SIGTERM);
+    }
+
+    if (waiter.joinable()) {
+        waiter.join();
+        close(exit_pipe[0]);
+        close(exit_pipe[1]);
+    } else {
+        while (waitpid(pid, &wait_status, 0) == -1 && errno == EINTR) {
+        }
+
+        close(exit_fd);
+    }
+
+    const int status{ hung_up ? 128 + SIGTERM : WIFSIGNALED(wait_status) ? 128 + WTERMSIG(wait_status) : WEXITSTATUS(wait_status) };
+    Reply(connection, request, static_cast<std::int32_t>(status));
+    return status;
+#endif
+}
+
+void DeclineRequest(int connection, const ServerRequest &request) {
+#if defined(_WIN32)
+    (void) connection;
+    (void) request;
+#else
+    Reply(connection, request, ServerDeclined);
+#endif
+}
+
+/**
+ * @brief ConfigEnvironmentVariables lists the environment variables which shape @ref Config::Load.
+ */
+static const std::vector<std::string> ConfigEnvironmentVariables{
+    "CC",
+    "CFLAGS",
+    "CPPFLAGS",
+    "CXX",
+    "CXXFLAGS",
+    "INCLUDE",
+    "LIB",
+    "PATH",
+    "REZ_ARCH",
+    "REZ_COMPILER",
+    "REZ_DELEGATE_MODE",
+    "REZ_LINKER",
+    "REZ_PCH",
+    "REZ_PROFILE",
+    "REZ_SHARED_CACHE",
+    "REZ_TOOLCHAIN_QUERY_PATH"
+};
+
+std::string ConfigEnvironmentDigest() {
+    std::string entries;
+
+    for (const std::string &key : ConfigEnvironmentVariables) {
+        const std::optional<std::string> value{ GetEnvironmentVariable(key) };
+        entries += key;
+        entries += value.has_value() ? "=" + *value : "";
+        entries += '\0';
+    }
+
+    std::uint64_t h{ HashBytes(entries.data(), entries.size(), 0) };
+    const std::optional<std::string> toolchain_script{ GetEnvironmentVariable("REZ_TOOLCHAIN_QUERY_PATH") };
+    std::error_code ec;
+
+    // Editing the toolchain script changes the configuration too.
+    if (toolchain_script.has_value() && std::filesystem::is_regular_file(*toolchain_script, ec)) {
+        h = HashFile(*toolchain_script, h);
+    }
+
+    return HexDigest(h);
+}
+
+std::optional<int> ForwardToServer(const std::filesystem::path &socket_path, const std::vector<std::string> &args, const std::string &environment_digest) {
+#if defined(_WIN32)
+    (void) socket_path;
+    (void) args;
+    (void) environment_digest;
+    return std::nullopt;
+#else
+    const int fd{ ConnectSocket(socket_path) };
+
+    if (fd == -1) {
+        return std::nullopt;
+    }
+
+    std::error_code ec;
+    std::string payload{ std::filesystem::current_path(ec).string() };
+    payload += '\0';
+    payload += environment_digest;
+    payload += '\0';
+    payload += std::to_string(args.size());
+    payload += '\0';
+
+    for (const std::string &arg : args) {
+        payload += arg;
+        payload += '\0';
+    }
+
+    for (char **entry = environ; *entry != nullptr; entry++) {
+        payload += *entry;
+        payload += '\0';
+    }
+
+    std::uint64_t size{ payload.size() };
+    iovec iov{ &size, sizeof(size) };
+    alignas(cmsghdr) char control[CMSG_SPACE(3 * sizeof(int))];
+    std::memset(control, 0, sizeof(control));
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr *header{ CMSG_FIRSTHDR(&message) };
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    const int fds[3]{ STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    std::memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    if (sendmsg(fd, &message, SendFlags) != static_cast<ssize_t>(sizeof(size)) || !SendAll(fd, payload.data(), payload.size())) {
+        close(fd);
+        return std::nullopt;
+    }
+
+    std::int32_t status{ EXIT_FAILURE };
+    const bool replied{ ReceiveAll(fd, reinterpret_cast<char *>(&status), sizeof(status)) };
+    close(fd);
+
+    if (!replied) {
+        std::cerr << "error: rez server disconnected: " << socket_path.string() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if (status == ServerDeclined) {
+        return std::nullopt;
+    }
+
+    return static_cast<int>(status);
+#endif
+}
+
+std::vector<HistoryRecord> ReadHistory(const std::filesystem::path &path) {
+    std::ifstream f(path, std::ios::binary);
+    const std::string bytes{ std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>() };
+    const std::size_t fixed_size{ 3 * sizeof(std::int64_t) + sizeof(std::int32_t) };
+    std::vector<HistoryRecord> records;
+    std::size_t offset{ 0 };
+
+    while (offset + 8 <= bytes.size() && bytes.compare(offset, 4, "RZH1") == 0) {
+        std::uint32_t size{ 0 };
+        std::memcpy(&size, bytes.data() + offset + 4, sizeof(size));
+
+        if (size < fixed_size || offset + 8 + size > bytes.size()) {
+            break;
+        }
+
+        const char *field{ bytes.data() + offset + 8 };
+        HistoryRecord record;
+        std::memcpy(&record.start, field, sizeof(record.start));
+        std::memcpy(&record.wall, field + 8, sizeof(record.wall));
+        std::memcpy(&record.cpu, field + 16, sizeof(record.cpu));
+        std::memcpy(&record.status, field + 24, sizeof(record.status));
+        record.name.assign(field + fixed_size, size - fixed_size);
+        records.push_back(std::move(record));
+        offset += 8 + size;
+    }
+
+    return records;
+}
+
+void CompactHistory(const std::filesystem::path &path) {
+    const FileLock lock(path.parent_path() / LockFileBasename);
+    const std::vector<HistoryRecord> records{ ReadHistory(path) };
+    std::map<std::string, std::size_t> counts;
+
+    for (const HistoryRecord &record : records) {
+        counts[record.name]++;
+    }
+
+    // Keep each name's most recent records, in their original order.
+    std::map<std::string, std::size_t> seen;
+    std::filesystem::path temp_path{ path };
+    temp_path += ".tmp";
+
+    {
+        std::ofstream f(temp_path, std::ios::binary | std::ios::trunc);
+
+        for (const HistoryRecord &record : records) {
+            if (seen[record.name]++ + HistoryKeep >= counts[record.name]) {
+                const std::string bytes{ History::Encode(record) };
+                f.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+            }
+        }
+
+        if (!f) {
+            throw std::runtime_error("error writing history: "s + temp_path.string());
+        }
+    }
+
+    std::filesystem::rename(temp_path, path);
+}
 }